@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <avr/io.h>
 
+#include "RDConfig.h"
 #include "RDPinDefs.h"
 #include "RDConstants.h"
 #include "RDUtil.h"
@@ -205,4 +206,29 @@ uint16_t RDAnalogReadAvg(unsigned char channel, unsigned char mode, uint16_t sam
 	return (uint16_t)(sum/samples);
 }
 
+/**
+ * Reads an analog signal and applies the offset and gain calibration stored
+ * in the config (see RDConfig), clamped to the range of mode.
+ *
+ * @param channel
+ *     The pin that should be read (0 - 7).
+ * 
+ * @param mode
+ *     The mode can be MODE_8_BIT or MODE_10_BIT.
+ * 
+ * @return
+ *     Calibrated digital representation of analog signal.
+ */
+uint16_t RDAnalogReadCal(unsigned char channel, unsigned char mode) {
+    RDConfig *settings = RDConfigGet();
+    int32_t value = (int32_t) RDAnalogRead(channel, mode) + settings->adcOffset;
+    int32_t max = (mode == MODE_8_BIT) ? 255 : 1023;
+
+    value = (value * settings->adcGain) / RDCONFIG_ADC_GAIN_ONE;
+    if (value < 0) {
+        return 0;
+    }
+    return (value > max) ? max : value;
+}
+
 #endif //RDANALOG_H_
@@ -9,8 +9,10 @@
  */ 
 
 #include <avr/io.h>
+#include <string.h>
 #include <util/delay.h>
 
+#include "RDConfig.h"
 #include "RDPinDefs.h"
 #include "RDUART.h"
 
@@ -42,6 +44,11 @@
 
 static volatile char bluetoothBaud = 0;
 
+/**
+ * Time the last baud-rate detection took, in ms.
+ */
+static uint16_t bluetoothDetectTime = 0;
+
 /**
  * Sets module name.
  *
@@ -216,14 +223,141 @@ static inline void RDBluetoothGetBaud(void) {
 }
 
 /**
- * Initialises UART to module's current baud-rate.
+ * Fixed part of the wait for the module's reply to "AT", in ms. The time
+ * "AT" and "OK" spend on the wire is added per baud-rate.
+ */
+#ifndef RDBLUETOOTH_PROBE_LATENCY_MS
+#define RDBLUETOOTH_PROBE_LATENCY_MS 100
+#endif // RDBLUETOOTH_PROBE_LATENCY_MS
+
+/**
+ * Baud-rate designators in the order they are tried after the last-known
+ * one: the factory default first, then the usual choices.
+ */
+static const char bluetoothBaudOrder[] = "487659321ABC";
+
+/**
+ * Checks for a valid baud-rate designator.
+ *
+ * @param baud
+ *      Baud-rate designator (see RDBluetoothConfig header).
+ *
+ * @return
+ *      1 if valid, 0 otherwise.
+ */
+static uint8_t RDBluetoothValidBaud(char baud) {
+    return (baud >= '1' && baud <= '9') || (baud >= 'A' && baud <= 'C');
+}
+
+/**
+ * Pings the module at one baud-rate, waiting only as long as a reply at that
+ * rate could take.
+ *
+ * @param baud
+ *      Baud-rate designator to try.
+ *
+ * @return
+ *      1 if the module answered "OK", 0 otherwise.
+ */
+static uint8_t RDBluetoothProbe(char baud) {
+    unsigned long baudUL = RDBluetoothReturnBaudUL(baud);
+    // "AT" out and "OK" back: 4 characters of 10 bits each
+    uint16_t timeout = RDBLUETOOTH_PROBE_LATENCY_MS +
+                       (uint16_t) ((40000UL + baudUL - 1) / baudUL);
+    uint8_t okMatch = 0;
+
+    RDUARTInit(baudUL);
+    while (RDUARTAvailable()) {
+        RDUARTGetChar();            // Drop noise from the previous rate
+    }
+    RDUARTSendChar('A');
+    RDUARTSendChar('T');
+
+    while (timeout) {
+        while (RDUARTAvailable()) {
+            char c = RDUARTGetChar();
+
+            if (c == "OK"[okMatch]) {
+                if (++okMatch == 2) {
+                    return 1;
+                }
+            } else {
+                okMatch = (c == 'O') ? 1 : 0;
+            }
+        }
+        _delay_ms(1);
+        bluetoothDetectTime++;
+        timeout--;
+    }
+    return 0;
+}
+
+/**
+ * Saves the baud-rate designator the module is now at to the EEPROM config.
+ *
+ * @param baud
+ *      Baud-rate designator.
+ */
+static void RDBluetoothStoreBaud(char baud) {
+    RDConfigGet()->btBaud = baud;
+    RDConfigSave();
+}
+
+/**
+ * Queries module for set baud-rate, trying the last-known rate from EEPROM
+ * first and the others from most to least likely. Much faster than
+ * RDBluetoothGetBaud, which waits the same 700 ms at every rate.
+ *
+ * @return
+ *      Baud-rate designator the module answered at, also saved to
+ *      bluetoothBaud and EEPROM,
+ *      0 if it did not answer at any rate.
+ */
+char RDBluetoothDetectBaud(void) {
+    char last = RDConfigGet()->btBaud;
+    char found = 0;
+
+    bluetoothDetectTime = 0;
+    if (RDBluetoothValidBaud(last) && RDBluetoothProbe(last)) {
+        found = last;
+    }
+    for (uint8_t i = 0; !found && bluetoothBaudOrder[i] != '\0'; i++) {
+        if (bluetoothBaudOrder[i] != last &&
+                RDBluetoothProbe(bluetoothBaudOrder[i])) {
+            found = bluetoothBaudOrder[i];
+        }
+    }
+    if (found) {
+        bluetoothBaud = found;
+        RDBluetoothStoreBaud(found);
+    }
+    return found;
+}
+
+/**
+ * Gets the time the last call to RDBluetoothDetectBaud (or RDBluetoothInit)
+ * spent waiting for replies.
+ *
+ * @return
+ *      Detection time in ms.
+ */
+uint16_t RDBluetoothGetDetectTime(void) {
+    return bluetoothDetectTime;
+}
+
+/**
+ * Initialises UART to module's current baud-rate. If the module does not
+ * answer, the last-known baud-rate is used.
  *
  * @return
  *      Baud-rate detected from module.
  */
 unsigned long RDBluetoothInit(void) {
     // Get current baud-rate
-    RDBluetoothGetBaud();
+    if (!RDBluetoothDetectBaud()) {
+        char last = RDConfigGet()->btBaud;
+        bluetoothBaud = RDBluetoothValidBaud(last) ? last : RDCONFIG_DEFAULT_BAUD;
+    }
     // Initialize UART with last baud-rate
     unsigned long baud = RDBluetoothReturnBaudUL(bluetoothBaud);
     RDUARTInit(baud);
@@ -231,10 +365,83 @@ unsigned long RDBluetoothInit(void) {
     return baud;
 }
 
+/**
+ * Checks whether the EEPROM config says the module already has these
+ * settings.
+ *
+ * @return
+ *      1 if name, pin and baud match the stored settings, 0 otherwise.
+ */
+static uint8_t RDBluetoothConfigStored(const char *name, const char *pin,
+                                       char baud) {
+    RDConfig *settings = RDConfigGet();
+
+    return RDConfigValid() && settings->btBaud == baud &&
+           strlen(name) < RDCONFIG_NAME_SIZE &&
+           strlen(pin) < RDCONFIG_PIN_SIZE &&
+           strcmp(settings->btName, name) == 0 &&
+           strcmp(settings->btPin, pin) == 0;
+}
+
+/**
+ * Records settings just pushed to the module in the EEPROM config. Names or
+ * pins too long for the config are stored empty, so they never match.
+ */
+static void RDBluetoothConfigStore(const char *name, const char *pin,
+                                   char baud) {
+    RDConfig *settings = RDConfigGet();
+
+    settings->btBaud = baud;
+    settings->btName[0] = '\0';
+    settings->btPin[0] = '\0';
+    if (strlen(name) < RDCONFIG_NAME_SIZE) {
+        strcpy(settings->btName, name);
+    }
+    if (strlen(pin) < RDCONFIG_PIN_SIZE) {
+        strcpy(settings->btPin, pin);
+    }
+    RDConfigSave();
+}
+
 /**
  * Renames device, sets pin, and changes current baud-rate. UART is reconfigured
  * automatically to the new baud-rate. Module is automatically placed and 
- * brought out of configuration mode.
+ * brought out of configuration mode. Unlike RDBluetoothConfig, this always
+ * talks to the module.
+ *
+ * @param name
+ *      Name of the module.
+ *
+ * @param pin
+ *      Module pairing pin.
+ *
+ * @param baud
+ *      Corresponding baud-rate designator, see RDBluetoothConfig.
+ */
+void RDBluetoothConfigForce(char *name, char* pin, char baud) {
+    
+    RDBluetoothEnterConfigMode();
+    
+    _delay_ms(750);    
+    // Configure
+    RDBluetoothSetName(name);	// Set name
+    RDBluetoothSetPin(pin);		// Set pin
+    RDBluetoothSetBR(baud);		// Set baud rate
+    
+    _delay_ms(750);   
+	
+    RDBluetoothRestart();
+    
+    bluetoothBaud = baud;		// Update baud rate
+    RDBluetoothConfigStore(name, pin, baud);
+    RDUARTInit( RDBluetoothReturnBaudUL(bluetoothBaud) );	// Reinitialise UART with new baud
+}
+
+/**
+ * Renames device, sets pin, and changes current baud-rate. UART is reconfigured
+ * automatically to the new baud-rate. Module is automatically placed and 
+ * brought out of configuration mode. Skipped, apart from reconfiguring the
+ * UART, when the EEPROM config shows the module already has these settings.
  * 
  * @param name
  *      Name of the module.
@@ -260,20 +467,351 @@ unsigned long RDBluetoothInit(void) {
  */
 void RDBluetoothConfig(char *name, char* pin, char baud) {
     
-    RDBluetoothEnterConfigMode();
-    
-    _delay_ms(750);    
-    // Configure
-    RDBluetoothSetName(name);	// Set name
-    RDBluetoothSetPin(pin);		// Set pin
-    RDBluetoothSetBR(baud);		// Set baud rate
-    
-    _delay_ms(750);   
-	
-    RDBluetoothRestart();
-    
-    bluetoothBaud = baud;		// Update baud rate
-    RDUARTInit( RDBluetoothReturnBaudUL(bluetoothBaud) );	// Reinitialise UART with new baud
+    if (RDBluetoothConfigStored(name, pin, baud)) {
+        bluetoothBaud = baud;
+        RDUARTInit( RDBluetoothReturnBaudUL(bluetoothBaud) );
+        return;
+    }
+    RDBluetoothConfigForce(name, pin, baud);
+}
+
+/*
+ * ASYNCHRONOUS CONFIGURATION
+ *
+ *      RDBluetoothConfigAsync("Robot", "1234", '8', NULL);
+ *      while (1) {
+ *          RDBluetoothTick(msSinceLastTick);
+ *          // Control loop keeps running
+ *      }
+ *
+ * The same AT sequence as RDBluetoothConfig is run as a state machine,
+ * advanced by RDBluetoothTick. Each command waits for the module's "OK"
+ * (up to RDBLUETOOTH_AT_TIMEOUT_MS) instead of a fixed delay, and completion
+ * is reported through RDBluetoothStatus and an optional callback.
+ */
+
+/**
+ * Longest wait for the "OK" reply to an AT command, in ms.
+ */
+#ifndef RDBLUETOOTH_AT_TIMEOUT_MS
+#define RDBLUETOOTH_AT_TIMEOUT_MS   1000
+#endif // RDBLUETOOTH_AT_TIMEOUT_MS
+
+/**
+ * Quiet time after a reply before the next AT command, in ms. The module
+ * detects the end of a command by a pause on the line.
+ */
+#ifndef RDBLUETOOTH_AT_GAP_MS
+#define RDBLUETOOTH_AT_GAP_MS       100
+#endif // RDBLUETOOTH_AT_GAP_MS
+
+/**
+ * Most AT commands in one asynchronous job.
+ */
+#define RDBLUETOOTH_MAX_COMMANDS    3
+
+/**
+ * Asynchronous status: no job has been started.
+ */
+#define RDBLUETOOTH_IDLE    0
+
+/**
+ * Asynchronous status: a job is running.
+ */
+#define RDBLUETOOTH_BUSY    1
+
+/**
+ * Asynchronous status: the last job finished and every command was
+ * acknowledged.
+ */
+#define RDBLUETOOTH_DONE    2
+
+/**
+ * Asynchronous status: the last job finished but a command was not
+ * acknowledged in time.
+ */
+#define RDBLUETOOTH_ERROR   3
+
+/*
+ * Steps of an asynchronous job.
+ */
+#define BT_STEP_IDLE        0
+#define BT_STEP_POWER_OFF   1
+#define BT_STEP_POWER_ON    2
+#define BT_STEP_SEND        3
+#define BT_STEP_WAIT_OK     4
+#define BT_STEP_GAP         5
+#define BT_STEP_SETTLE      6
+#define BT_STEP_RESTART     7
+
+/**
+ * One AT command: a preamble such as "AT+NAME" and an optional argument.
+ */
+typedef struct {
+    const char *preamble;
+    const char *argument;
+} RDBluetoothCommand;
+
+/**
+ * State of the asynchronous job.
+ */
+typedef struct {
+    uint8_t step;
+    uint8_t status;
+    uint8_t configMode;         // 1 to wrap the commands in config mode
+    uint8_t failed;             // 1 once a command went unacknowledged
+    uint8_t count;              // Number of commands
+    uint8_t index;              // Command being sent
+    uint8_t okMatch;            // Characters of "OK" matched so far
+    uint16_t timer;             // ms left in the current wait
+    char baud;                  // New baud designator, 0 to keep the UART
+    char baudArgument[2];
+    RDBluetoothCommand commands[RDBLUETOOTH_MAX_COMMANDS];
+    void (*callback)(uint8_t status);
+} RDBluetoothJob;
+
+static RDBluetoothJob bluetoothJob;
+
+/**
+ * Gets the status of the asynchronous job.
+ *
+ * @return
+ *      RDBLUETOOTH_IDLE, RDBLUETOOTH_BUSY, RDBLUETOOTH_DONE or
+ *      RDBLUETOOTH_ERROR.
+ */
+uint8_t RDBluetoothStatus(void) {
+    return bluetoothJob.status;
+}
+
+/**
+ * Starts an asynchronous job.
+ *
+ * @param configMode
+ *      1 to power-cycle the module into configuration mode first and
+ *      restart it afterwards, 0 to send the commands as they are.
+ *
+ * @param callback
+ *      Called with the final status when the job ends, or NULL.
+ *
+ * @return
+ *      1 if the job was started,
+ *      0 if another job is still running.
+ */
+static uint8_t RDBluetoothStartJob(uint8_t configMode,
+                                   void (*callback)(uint8_t status)) {
+    if (bluetoothJob.status == RDBLUETOOTH_BUSY) {
+        return 0;
+    }
+    bluetoothJob.status = RDBLUETOOTH_BUSY;
+    bluetoothJob.configMode = configMode;
+    bluetoothJob.failed = 0;
+    bluetoothJob.index = 0;
+    bluetoothJob.timer = 0;
+    bluetoothJob.callback = callback;
+    bluetoothJob.step = configMode ? BT_STEP_POWER_OFF : BT_STEP_SEND;
+    return 1;
+}
+
+/**
+ * Sends one AT command without waiting, and reports the result through
+ * RDBluetoothStatus and callback once RDBluetoothTick sees the "OK".
+ *
+ * @param command
+ *      The full command, e.g. "AT". Must stay valid until the job ends.
+ *
+ * @param callback
+ *      Called with the final status when the job ends, or NULL.
+ *
+ * @return
+ *      1 if the job was started,
+ *      0 if another job is still running.
+ */
+uint8_t RDBluetoothCommandAsync(const char *command,
+                                void (*callback)(uint8_t status)) {
+    if (!RDBluetoothStartJob(0, callback)) {
+        return 0;
+    }
+    bluetoothJob.commands[0].preamble = command;
+    bluetoothJob.commands[0].argument = "";
+    bluetoothJob.count = 1;
+    bluetoothJob.baud = 0;
+    return 1;
+}
+
+/**
+ * Non-blocking version of RDBluetoothConfig. Renames device, sets pin, and
+ * changes current baud-rate; the UART is reconfigured to the new baud-rate
+ * when the job ends successfully. When the EEPROM config shows the module
+ * already has these settings, the job ends at once with RDBLUETOOTH_DONE.
+ *
+ * @param name
+ *      Name of the module. Must stay valid until the job ends.
+ *
+ * @param pin
+ *      Module pairing pin. Must stay valid until the job ends.
+ *
+ * @param baud
+ *      Corresponding baud-rate designator, see RDBluetoothConfig.
+ *
+ * @param callback
+ *      Called with the final status when the job ends, or NULL.
+ *
+ * @return
+ *      1 if the job was started,
+ *      0 if another job is still running.
+ */
+uint8_t RDBluetoothConfigAsync(const char *name, const char *pin, char baud,
+                               void (*callback)(uint8_t status)) {
+    if (!RDBluetoothStartJob(1, callback)) {
+        return 0;
+    }
+    if (RDBluetoothConfigStored(name, pin, baud)) {
+        bluetoothBaud = baud;
+        RDUARTInit(RDBluetoothReturnBaudUL(bluetoothBaud));
+        bluetoothJob.status = RDBLUETOOTH_DONE;
+        bluetoothJob.step = BT_STEP_IDLE;
+        if (callback) {
+            callback(RDBLUETOOTH_DONE);
+        }
+        return 1;
+    }
+    bluetoothJob.baud = baud;
+    bluetoothJob.baudArgument[0] = baud;
+    bluetoothJob.baudArgument[1] = '\0';
+    bluetoothJob.commands[0].preamble = "AT+NAME";
+    bluetoothJob.commands[0].argument = name;
+    bluetoothJob.commands[1].preamble = "AT+PIN";
+    bluetoothJob.commands[1].argument = pin;
+    bluetoothJob.commands[2].preamble = "AT+BAUD";
+    bluetoothJob.commands[2].argument = bluetoothJob.baudArgument;
+    bluetoothJob.count = 3;
+    return 1;
+}
+
+/**
+ * Drops any bytes waiting in the UART input buffer.
+ */
+static void RDBluetoothFlushInput(void) {
+    while (RDUARTAvailable()) {
+        RDUARTGetChar();
+    }
+}
+
+/**
+ * Advances the asynchronous job. Call this regularly, e.g. once per control
+ * loop iteration; it never waits.
+ *
+ * @param elapsedMs
+ *      Milliseconds since the previous call.
+ *
+ * @return
+ *      Status of the job, see RDBluetoothStatus.
+ */
+uint8_t RDBluetoothTick(uint16_t elapsedMs) {
+    RDBluetoothJob *job = &bluetoothJob;
+
+    if (job->step == BT_STEP_IDLE) {
+        return job->status;
+    }
+
+    job->timer = (elapsedMs >= job->timer) ? 0 : job->timer - elapsedMs;
+
+    // Watch for "OK" as it arrives, whatever follows it
+    if (job->step == BT_STEP_WAIT_OK) {
+        while (job->okMatch < 2 && RDUARTAvailable()) {
+            char c = RDUARTGetChar();
+
+            if (c == "OK"[job->okMatch]) {
+                job->okMatch++;
+            } else {
+                job->okMatch = (c == 'O') ? 1 : 0;
+            }
+        }
+        if (job->okMatch == 2) {
+            job->timer = RDBLUETOOTH_AT_GAP_MS;
+            job->step = BT_STEP_GAP;
+        } else if (job->timer == 0) {
+            job->failed = 1;
+            job->timer = 0;
+            job->step = BT_STEP_SETTLE;
+        }
+        return job->status;
+    }
+
+    if (job->timer != 0) {
+        return job->status;
+    }
+
+    switch (job->step) {
+        case BT_STEP_POWER_OFF:
+            // Turn off module and pull KEY high
+            BTDDR |= BTPWR | KEYPIN;
+            BTPORT |= BTPWR;
+            BTPORT |= KEYPIN;
+            job->timer = 100;
+            job->step = BT_STEP_POWER_ON;
+            break;
+
+        case BT_STEP_POWER_ON:
+            // Turn on module and let it boot into config mode
+            BTPORT &= ~BTPWR;
+            job->timer = 750;
+            job->step = BT_STEP_SEND;
+            break;
+
+        case BT_STEP_SEND:
+            RDBluetoothFlushInput();
+            RDUARTPrintf("%s%s", job->commands[job->index].preamble,
+                         job->commands[job->index].argument);
+            job->okMatch = 0;
+            job->timer = RDBLUETOOTH_AT_TIMEOUT_MS;
+            job->step = BT_STEP_WAIT_OK;
+            break;
+
+        case BT_STEP_GAP:
+            // Rest of the reply (e.g. "OKsetname") has been and gone
+            RDBluetoothFlushInput();
+            if (++job->index < job->count) {
+                job->step = BT_STEP_SEND;
+            } else {
+                job->step = BT_STEP_SETTLE;
+            }
+            break;
+
+        case BT_STEP_SETTLE:
+            if (!job->configMode) {
+                job->step = BT_STEP_RESTART;
+                break;
+            }
+            // Pull KEY low and turn off module
+            BTPORT &= ~KEYPIN;
+            BTPORT |= BTPWR;
+            job->timer = 100;
+            job->step = BT_STEP_RESTART;
+            break;
+
+        case BT_STEP_RESTART:
+            if (job->configMode) {
+                BTPORT &= ~BTPWR;       // Turn on module
+            }
+            if (!job->failed && job->baud) {
+                bluetoothBaud = job->baud;
+                RDBluetoothConfigStore(job->commands[0].argument,
+                                       job->commands[1].argument, job->baud);
+                RDUARTInit(RDBluetoothReturnBaudUL(bluetoothBaud));
+            }
+            job->status = job->failed ? RDBLUETOOTH_ERROR : RDBLUETOOTH_DONE;
+            job->step = BT_STEP_IDLE;
+            if (job->callback) {
+                job->callback(job->status);
+            }
+            break;
+
+        default:
+            job->step = BT_STEP_IDLE;
+            break;
+    }
+    return job->status;
 }
 
 #endif // RDBLUETOOTH_H_
\ No newline at end of file
@@ -0,0 +1,74 @@
+/*
+ * libRobotDev
+ * RDCRC.h
+ * Purpose: Provides checksum functions
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: UNTESTED
+ */
+
+#include <stdint.h>
+
+#ifndef RDCRC_H_
+/**
+ * Robot Development CRC Header.
+ */
+#define RDCRC_H_
+
+/**
+ * Initial value of a CRC-16/CCITT-FALSE checksum.
+ */
+#define RDCRC16_INIT 0xFFFF
+
+/*
+ * CRC-16/CCITT-FALSE (polynomial 0x1021, no reflection, no final XOR)
+ * remainders for each 4-bit value. Processing a nibble at a time keeps the
+ * table at 32 bytes instead of the 512 bytes a byte-wide table needs.
+ */
+static const uint16_t RDCRC16Table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/**
+ * Adds one byte to a CRC-16/CCITT-FALSE checksum.
+ * Appending the final checksum to the data, high byte first, and running it
+ * through this function as well gives 0, which is how receivers check it.
+ *
+ * @param crc
+ *     Checksum so far, RDCRC16_INIT for the first byte.
+ *
+ * @param data
+ *     The byte to add.
+ *
+ * @return
+ *     Updated checksum.
+ */
+static inline uint16_t RDCRC16Update(uint16_t crc, uint8_t data) {
+    crc = (crc << 4) ^ RDCRC16Table[(crc >> 12) ^ (data >> 4)];
+    crc = (crc << 4) ^ RDCRC16Table[(crc >> 12) ^ (data & 0x0F)];
+    return crc;
+}
+
+/**
+ * Calculates the CRC-16/CCITT-FALSE checksum of a buffer.
+ *
+ * @param data
+ *     Pointer to buffer.
+ *
+ * @param length
+ *     The length of the buffer.
+ *
+ * @return
+ *     Checksum of the buffer.
+ */
+uint16_t RDCRC16(const uint8_t *data, uint16_t length) {
+    uint16_t crc = RDCRC16_INIT;
+
+    while (length--) {
+        crc = RDCRC16Update(crc, *data++);
+    }
+    return crc;
+}
+
+#endif // RDCRC_H_
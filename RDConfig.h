@@ -0,0 +1,192 @@
+/*
+ * libRobotDev
+ * RDConfig.h
+ * Purpose: Persistent settings stored in EEPROM
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: UNTESTED
+ */
+
+/*
+ * USAGE
+ *
+ *      RDConfig *config = RDConfigGet();
+ *      config->lcdContrast = 0x45;
+ *      RDConfigSave();
+ *
+ * The settings live in one EEPROM block with a version byte and a CRC. When
+ * the block is blank, corrupt or from another version of this layout,
+ * RDConfigGet returns defaults and RDConfigValid returns 0. RDConfigSave only
+ * writes the bytes that changed, so saving unchanged settings costs no EEPROM
+ * wear.
+ *
+ * RDBluetooth uses the stored baud-rate, name and pin to skip reconfiguring
+ * a module that already has them, and RDLCDInit uses the stored contrast.
+ */
+
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "RDCRC.h"
+
+#ifndef RDCONFIG_H_
+/**
+ * Robot Development Config Header.
+ */
+#define RDCONFIG_H_
+
+/**
+ * Layout version. Change it whenever RDConfig changes so that old blocks are
+ * ignored rather than misread.
+ */
+#define RDCONFIG_VERSION 1
+
+/**
+ * Size of the Bluetooth name field, including the null-terminator.
+ */
+#define RDCONFIG_NAME_SIZE 21
+
+/**
+ * Size of the Bluetooth pin field, including the null-terminator.
+ */
+#define RDCONFIG_PIN_SIZE 9
+
+/**
+ * Default Bluetooth baud-rate designator (9600, the module's factory rate).
+ */
+#define RDCONFIG_DEFAULT_BAUD '4'
+
+/**
+ * Default LCD contrast, same as RDLCD_DEFAULT_CONTRAST.
+ */
+#define RDCONFIG_DEFAULT_CONTRAST 0x3F
+
+/**
+ * ADC gain representing 1.0, see RDConfig.adcGain.
+ */
+#define RDCONFIG_ADC_GAIN_ONE 1024
+
+/**
+ * Stored settings.
+ */
+typedef struct {
+    uint8_t version;
+    char btBaud;                        // Baud-rate designator, 0 if unknown
+    char btName[RDCONFIG_NAME_SIZE];    // Empty if never configured
+    char btPin[RDCONFIG_PIN_SIZE];      // Empty if never configured
+    uint8_t lcdContrast;
+    int16_t adcOffset;                  // Counts added to raw readings
+    uint16_t adcGain;                   // Scale, RDCONFIG_ADC_GAIN_ONE = 1.0
+    uint16_t crc;                       // Of everything above
+} RDConfig;
+
+/**
+ * The block in EEPROM.
+ */
+static RDConfig rdConfigEEPROM EEMEM;
+
+/**
+ * Copy of the settings in RAM.
+ */
+static RDConfig rdConfig;
+
+/**
+ * 1 once rdConfig has been loaded from EEPROM.
+ */
+static uint8_t rdConfigLoaded = 0;
+
+/**
+ * 1 if the EEPROM held a valid block when it was loaded, or after saving.
+ */
+static uint8_t rdConfigValid = 0;
+
+/**
+ * Calculates the checksum of a settings block.
+ *
+ * @param settings
+ *     The settings.
+ *
+ * @return
+ *     Checksum of every field but crc.
+ */
+static uint16_t RDConfigCRC(const RDConfig *settings) {
+    return RDCRC16((const uint8_t *) settings, offsetof(RDConfig, crc));
+}
+
+/**
+ * Fills a settings block with defaults.
+ *
+ * @param settings
+ *     The settings to fill.
+ */
+void RDConfigDefaults(RDConfig *settings) {
+    memset(settings, 0, sizeof(RDConfig));
+    settings->version = RDCONFIG_VERSION;
+    settings->btBaud = RDCONFIG_DEFAULT_BAUD;
+    settings->lcdContrast = RDCONFIG_DEFAULT_CONTRAST;
+    settings->adcOffset = 0;
+    settings->adcGain = RDCONFIG_ADC_GAIN_ONE;
+}
+
+/**
+ * Reads the settings from EEPROM, replacing them with defaults if the block
+ * is not valid.
+ *
+ * @return
+ *     1 if the EEPROM held a valid block,
+ *     0 if defaults were used.
+ */
+uint8_t RDConfigLoad(void) {
+    eeprom_read_block(&rdConfig, &rdConfigEEPROM, sizeof(RDConfig));
+    rdConfigValid = (rdConfig.version == RDCONFIG_VERSION &&
+                     rdConfig.crc == RDConfigCRC(&rdConfig));
+    if (!rdConfigValid) {
+        RDConfigDefaults(&rdConfig);
+    }
+    // Never trust strings from EEPROM to be terminated
+    rdConfig.btName[RDCONFIG_NAME_SIZE - 1] = '\0';
+    rdConfig.btPin[RDCONFIG_PIN_SIZE - 1] = '\0';
+    rdConfigLoaded = 1;
+    return rdConfigValid;
+}
+
+/**
+ * Gets the settings, loading them from EEPROM on first use. Changes made
+ * through the returned pointer are kept in RAM until RDConfigSave.
+ *
+ * @return
+ *     Pointer to the settings.
+ */
+RDConfig *RDConfigGet(void) {
+    if (!rdConfigLoaded) {
+        RDConfigLoad();
+    }
+    return &rdConfig;
+}
+
+/**
+ * Checks whether the settings came from EEPROM rather than defaults.
+ *
+ * @return
+ *     1 if valid, 0 otherwise.
+ */
+uint8_t RDConfigValid(void) {
+    RDConfigGet();
+    return rdConfigValid;
+}
+
+/**
+ * Writes the settings to EEPROM. Only bytes that differ from what is already
+ * stored are written.
+ */
+void RDConfigSave(void) {
+    RDConfigGet();
+    rdConfig.version = RDCONFIG_VERSION;
+    rdConfig.crc = RDConfigCRC(&rdConfig);
+    eeprom_update_block(&rdConfig, &rdConfigEEPROM, sizeof(RDConfig));
+    rdConfigValid = 1;
+}
+
+#endif // RDCONFIG_H_
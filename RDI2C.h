@@ -5,19 +5,148 @@
  * Created: 08/12/2014
  * Author(s): Arda Yilmaz
  * Status: UNTESTED
- */ 
+ */
+
+/*
+ * TRANSACTION QUEUE
+ *
+ *      static uint8_t reg = 0x3B;
+ *      static uint8_t imu[6];
+ *      static RDI2CTransfer imuRead = {
+ *          .addr = 0x68,
+ *          .txBuffer = &reg, .txLength = 1,
+ *          .rxBuffer = imu, .rxLength = 6
+ *      };
+ *
+ *      RDI2CSubmit(&imuRead);
+ *      // ... do other work ...
+ *      if (imuRead.status == RDI2C_DONE) { ... }
+ *
+ * A transfer writes txLength bytes, then reads rxLength bytes. When it has
+ * both, the read follows a repeated start, so nothing else can get onto the
+ * bus in between. Submitted transfers are queued and run back-to-back
+ * entirely inside TWI_vect; status changes from RDI2C_PENDING once the
+ * transfer has finished, after which the optional callback is called. The
+ * descriptor and its buffers must stay valid until then.
+ * The callback normally runs in TWI_vect, but for a transfer that times out
+ * it runs in RDI2CTick instead, i.e. wherever the program calls that. Either
+ * way interrupts are disabled while it runs, so it must be short and must
+ * not wait on the bus.
+ *
+ * REGISTER ACCESS
+ *
+ *      uint8_t imu[6];
+ *      RDI2CReadReg(0x68, 0x3B, imu, 6);
+ *
+ * Most sensors are read by writing a register pointer, then reading from it
+ * after a repeated start. RDI2CReadReg/RDI2CWriteReg do this in one bus
+ * transaction; the register byte is held in the descriptor (RDI2C_REG), so
+ * neither the caller nor the library has to copy it in front of the data.
+ * The Async versions fill in and submit a caller-owned descriptor instead of
+ * waiting.
+ *
+ * ZERO-COPY WRITES
+ *
+ *      static RDI2CTransfer page;
+ *      RDI2CWriteRegAsync(&page, 0x50, 0x00, eepromPage, 64, NULL);
+ *      // eepromPage must not change until page.status != RDI2C_PENDING
+ *
+ * The Async functions stream straight from the caller's buffer, so there is
+ * no size limit and no copy. RDI2CWrite instead copies into library memory
+ * and returns at once: staticBuffer (one write at a time, at most
+ * RDI2C_BUFFER_SIZE bytes), or with RDI2C_DYNAMIC, a fixed pool of
+ * RDI2C_POOL_BLOCKS blocks of RDI2C_POOL_BLOCK_SIZE bytes, each with its own
+ * descriptor, so that several copied writes can be queued without malloc.
+ *
+ * ERROR RECOVERY
+ *
+ *      ISR(TIMER0_COMPA_vect) {        // Every 1 ms
+ *          RDI2CTick(1);
+ *      }
+ *
+ * A slave that does not answer its address is retried RDI2C_MAX_RETRIES
+ * times before the transfer ends with RDI2C_NACK; arbitration losses are
+ * retried the same way. A transfer still on the bus after RDI2C_TIMEOUT_MS
+ * of RDI2CTick ends with RDI2C_TIMEOUT: the TWI is reset and the bus
+ * cleared by clocking SCL until a stuck slave lets go of SDA (see
+ * RDI2CBusClear), and the queue carries on. With RDI2C_STATS defined, the
+ * counters in RDI2CStats measure how often this happens.
+ * Asynchronous transfers only time out if something calls RDI2CTick, so
+ * call it from a timer interrupt as above (from the main loop works too,
+ * as long as nothing in the loop waits on the bus). The blocking calls,
+ * RDI2CRead, RDI2CWrite, RDI2CReadReg and RDI2CWriteReg, call RDI2CTick
+ * themselves while they wait, so they always return; with a timer calling
+ * it as well, their timeouts run up to twice as fast.
+ *
+ *      static RDI2CTransfer poll = { .addr = 0x50, .flags = RDI2C_NO_RETRY };
+ *      while (RDI2CWriteAsync(&poll, 0x50, NULL, 0, NULL),
+ *             RDI2CWait(&poll) == RDI2C_NACK);
+ *
+ * The retries on an unanswered address would hide the NACK an EEPROM gives
+ * while it is busy writing a page, so a transfer flagged RDI2C_NO_RETRY
+ * ends with RDI2C_NACK at the first one, for ack polling as above.
+ *
+ * BUS SPEED
+ *
+ *      RDI2CInitHz(100000);            // Bus default: 100 kHz
+ *      imuRead.flags |= RDI2C_FAST;    // This device manages 400 kHz
+ *
+ * RDI2CInitHz works out TWBR and the TWPS prescaler from F_CPU at compile
+ * time (for a constant argument), never exceeding the requested clock, and
+ * returns the SCL frequency actually achieved; RDI2CGetSCL reports the one
+ * in use. A transfer flagged RDI2C_FAST or RDI2C_STANDARD runs at 400 kHz or
+ * 100 kHz, and the bus returns to the RDI2CInitHz rate for unflagged ones.
+ *
+ * SLAVE MODE (RDI2C_SLAVE)
+ *
+ *      RDI2CSlaveInit(0x42, NULL);
+ *      while (1) {
+ *          volatile uint8_t *regs = RDI2CSlaveShadow();
+ *          regs[0] = range >> 8;
+ *          regs[1] = range & 0xFF;
+ *          RDI2CSlaveCommit();
+ *      }
+ *
+ * The board answers at its own address and exposes RDI2C_SLAVE_REGS bytes of
+ * registers. A master write sets the register pointer with its first byte
+ * and stores any further bytes from there; a master read returns bytes from
+ * the pointer on. The pointer increments after every byte and wraps at the
+ * end. The program fills a shadow copy and RDI2CSlaveCommit publishes it in
+ * one go, deferred until any read in progress has finished, so a master
+ * burst-reading a frame never sees half of an update. Master transfers can
+ * still be submitted; they wait for the bus while the board is addressed,
+ * and RDI2C_TIMEOUT_MS only counts from when they get it.
+ */
 
 #ifndef RDI2C_H_
 #define RDI2C_H_
 
+/**
+ * CPU Frequency, needed before <util/delay.h> and by RDI2C_TWBR.
+ */
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <util/atomic.h>
+#include <util/delay.h>
 
 #define I2C_STATUS		(TWSR & 0xf8)
-#define I2CStart()		(TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE))
-#define I2CStop()		(TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWEN) | (1 << TWIE))
+#ifdef RDI2C_SLAVE
+#define I2C_SLAVE_ACK	i2cSlaveAck
+#define I2C_SLAVE_BUSY	i2cSlaveBusy
+#else
+#define I2C_SLAVE_ACK	0
+#define I2C_SLAVE_BUSY	0
+#endif	// RDI2C_SLAVE
+
+#define I2CStart()		(TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE) | I2C_SLAVE_ACK)
+#define I2CStop()		(TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWEN) | (1 << TWIE) | I2C_SLAVE_ACK)
+#define I2CStopStart()	(TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE) | I2C_SLAVE_ACK)
 #define I2CACK()		(TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE) | (1 << TWEA))
 #define I2CNACK()		(TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE))
 #define I2CContinue()	(TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE))
@@ -36,208 +165,1170 @@
 #define MR_DATAR_ACK	0x50
 #define MR_DATAR_NACK	0x58
 
+#define SR_SLA_W_ACK	0x60
+#define SR_ARBIT_SLA_W	0x68
+#define SR_DATAR_ACK	0x80
+#define SR_DATAR_NACK	0x88
+#define SR_STOP			0xA0
+
+#define ST_SLA_R_ACK	0xA8
+#define ST_ARBIT_SLA_R	0xB0
+#define ST_DATAT_ACK	0xB8
+#define ST_DATAT_NACK	0xC0
+#define ST_LAST_DATAT	0xC8
+
+/**
+ * Transfer status: finished successfully (or never submitted).
+ */
+#define RDI2C_DONE		0
+
+/**
+ * Transfer status: queued or in progress.
+ */
+#define RDI2C_PENDING	1
+
+/**
+ * Transfer status: the slave refused data, or the bus misbehaved.
+ */
+#define RDI2C_ERROR		2
+
+/**
+ * Transfer status: the slave did not acknowledge its address.
+ */
+#define RDI2C_NACK		3
+
+/**
+ * Transfer status: the transfer did not finish within RDI2C_TIMEOUT_MS.
+ */
+#define RDI2C_TIMEOUT	4
+
+/**
+ * Transfer flag: send reg before txBuffer.
+ */
+#define RDI2C_REG		0x01
+
+/**
+ * Transfer flag: run at 400 kHz (Fast-mode).
+ */
+#define RDI2C_FAST		0x02
+
+/**
+ * Transfer flag: run at 100 kHz (Standard-mode).
+ */
+#define RDI2C_STANDARD	0x04
+
+/**
+ * Transfer flag: do not retry an unanswered address, see ERROR RECOVERY.
+ */
+#define RDI2C_NO_RETRY	0x08
+
+/**
+ * Flags the Async functions keep from the caller's descriptor.
+ */
+#define RDI2C_KEEP_FLAGS	(RDI2C_FAST | RDI2C_STANDARD | RDI2C_NO_RETRY)
+
+/*
+ * SCL = F_CPU / (16 + 2 * TWBR * 4^TWPS). RDI2C_TWPS(hz) picks the smallest
+ * prescaler whose TWBR fits in 8 bits and RDI2C_TWBR(hz) the matching TWBR,
+ * rounded up so that SCL never exceeds hz. Both fold to constants when hz
+ * is one.
+ */
+#define RDI2C_PRESCALE(twps)	(1UL << (2 * (twps)))
+#define RDI2C_CPU_DIV(hz)		(((F_CPU) + (hz) - 1) / (hz))
+#define RDI2C_TWBR_PS(hz, twps) \
+	(RDI2C_CPU_DIV(hz) <= 16 ? 0 : \
+	 (RDI2C_CPU_DIV(hz) - 16 + 2 * RDI2C_PRESCALE(twps) - 1) / \
+	 (2 * RDI2C_PRESCALE(twps)))
+#define RDI2C_TWPS(hz) \
+	(RDI2C_TWBR_PS((hz), 0) <= 255 ? 0 : \
+	 RDI2C_TWBR_PS((hz), 1) <= 255 ? 1 : \
+	 RDI2C_TWBR_PS((hz), 2) <= 255 ? 2 : 3)
+#define RDI2C_TWBR(hz) \
+	(RDI2C_TWBR_PS((hz), RDI2C_TWPS(hz)) > 255 ? 255 : \
+	 RDI2C_TWBR_PS((hz), RDI2C_TWPS(hz)))
+#define RDI2C_SCL_HZ(twbr, twps) \
+	((F_CPU) / (16 + 2UL * (twbr) * RDI2C_PRESCALE(twps)))
+
+/**
+ * Number of queue slots; one fewer transfers can be queued. Must be a power
+ * of two.
+ */
+#ifndef RDI2C_QUEUE_SIZE
+#define RDI2C_QUEUE_SIZE	8
+#endif	// RDI2C_QUEUE_SIZE
+
+#if (RDI2C_QUEUE_SIZE & (RDI2C_QUEUE_SIZE - 1)) != 0 || RDI2C_QUEUE_SIZE > 256
+#error "RDI2C_QUEUE_SIZE must be a power of two, at most 256"
+#endif
+
+#define RDI2C_QUEUE_MASK	(RDI2C_QUEUE_SIZE - 1)
+
+/**
+ * Times an unanswered address or lost arbitration is retried.
+ */
+#ifndef RDI2C_MAX_RETRIES
+#define RDI2C_MAX_RETRIES	3
+#endif	// RDI2C_MAX_RETRIES
+
+/**
+ * Longest time a transfer may spend on the bus, in ms of RDI2CTick.
+ */
+#ifndef RDI2C_TIMEOUT_MS
+#define RDI2C_TIMEOUT_MS	25
+#endif	// RDI2C_TIMEOUT_MS
+
+/**
+ * I2C pins, used to clear the bus.
+ */
+#define RDI2C_SCL		PD0
+#define RDI2C_SDA		PD1
+#define RDI2C_PORT		PORTD
+#define RDI2C_DDR		DDRD
+#define RDI2C_PIN		PIND
+
+/* Uncomment this define (or define it before including this header) to keep
+ * I2C statistics, see RDI2CGetStats.
+ */
+// #define RDI2C_STATS
+
+/* Uncomment this define (or define it before including this header) to
+ * enable slave mode, see RDI2CSlaveInit.
+ */
+// #define RDI2C_SLAVE
+
+#ifdef RDI2C_SLAVE
+/**
+ * Size of the slave register file.
+ */
+#ifndef RDI2C_SLAVE_REGS
+#define RDI2C_SLAVE_REGS	32
+#endif	// RDI2C_SLAVE_REGS
+
+#if RDI2C_SLAVE_REGS > 256
+#error "RDI2C_SLAVE_REGS must be at most 256"
+#endif
+#endif	// RDI2C_SLAVE
+
 #ifndef RDI2C_DYNAMIC
 #ifndef	RDI2C_BUFFER_SIZE
 #define	RDI2C_BUFFER_SIZE	16
 #endif	// RDI2C_BUFFER_SIZE
 static uint8_t staticBuffer[RDI2C_BUFFER_SIZE];
+#else
+#ifndef	RDI2C_POOL_BLOCKS
+#define	RDI2C_POOL_BLOCKS	4
+#endif	// RDI2C_POOL_BLOCKS
+#ifndef	RDI2C_POOL_BLOCK_SIZE
+#define	RDI2C_POOL_BLOCK_SIZE	32
+#endif	// RDI2C_POOL_BLOCK_SIZE
 #endif	// RDI2C_DYNAMIC
 
-typedef struct I2CSM {
+/**
+ * Transaction descriptor. Fields left out of an initialiser are 0, i.e. no
+ * callback and no register byte; status is managed by RDI2CSubmit.
+ */
+typedef struct RDI2CTransfer {
 
-	uint8_t SLA_RW;
-	uint8_t	repeat;
-	uint8_t *buffer;
-	uint8_t bufferIndex;
-	uint8_t bufferLength;	
-} I2CSM;
+	uint8_t addr;					// 7-bit slave address
+	const uint8_t *txBuffer;		// Bytes to write first
+	uint8_t txLength;
+	uint8_t *rxBuffer;				// Where to read bytes into
+	uint8_t rxLength;
+	void (*callback)(struct RDI2CTransfer *transfer);
+	uint8_t flags;					// RDI2C_REG, RDI2C_FAST, ...
+	uint8_t reg;					// Register pointer, see RDI2C_REG
+	volatile uint8_t status;
+#ifdef RDI2C_STATS
+	uint16_t submitted;				// i2cTime when submitted
+#endif	// RDI2C_STATS
+} RDI2CTransfer;
 
-static I2CSM RDI2CSM = {0, 0, NULL, 0, 0, };
+#ifdef RDI2C_STATS
+/**
+ * I2C statistics.
+ */
+typedef struct {
+	uint16_t transfers;				// Transfers finished, in any way
+	uint16_t nacks;					// Addresses not acknowledged
+	uint16_t arbitrationLosses;
+	uint16_t timeouts;
+	uint16_t errors;				// Data refused or unexpected bus states
+	uint32_t bytes;					// Data bytes moved, either direction
+	uint32_t latency;				// Sum of submit-to-finish times, in ms
+} RDI2CStats;
+
+static volatile RDI2CStats i2cStats;
+
+/**
+ * Time counted by RDI2CTick, in ms.
+ */
+static volatile uint16_t i2cTime = 0;
+#endif	// RDI2C_STATS
+
+#ifdef RDI2C_SLAVE
+/**
+ * Slave register file: the copy masters read, and the shadow the program
+ * fills before RDI2CSlaveCommit.
+ */
+static volatile uint8_t i2cSlaveRegs[RDI2C_SLAVE_REGS];
+static volatile uint8_t i2cSlaveShadow[RDI2C_SLAVE_REGS];
+
+/**
+ * TWEA while slave mode is on, so the TWI keeps answering its address.
+ */
+static volatile uint8_t i2cSlaveAck = 0;
+
+static uint8_t i2cSlavePointer = 0;
+static uint8_t i2cSlaveFirst = 0;		// Next byte written sets the pointer
+static uint8_t i2cSlaveStart = 0;		// Pointer at the start of a write
+static uint8_t i2cSlaveWritten = 0;		// Bytes stored by the current write
+static volatile uint8_t i2cSlaveBusy = 0;		// Addressed by a master
+static volatile uint8_t i2cSlaveReading = 0;	// Master is reading
+static volatile uint8_t i2cSlaveCommitPending = 0;
+
+/**
+ * Called from TWI_vect after a master has written registers, or NULL.
+ */
+static void (*i2cSlaveOnWrite)(uint8_t reg, uint8_t length) = NULL;
+#endif	// RDI2C_SLAVE
+
+/**
+ * Queue of submitted transfers; same head/tail convention as the UART ring
+ * buffers. Only the main program adds and only TWI_vect removes.
+ */
+static RDI2CTransfer * volatile i2cQueue[RDI2C_QUEUE_SIZE];
+static volatile uint8_t i2cQueueHead = 0;
+static volatile uint8_t i2cQueueTail = 0;
+
+/**
+ * Transfer on the bus, NULL while idle.
+ */
+static RDI2CTransfer * volatile i2cActive = NULL;
+
+/**
+ * Progress through the active transfer.
+ */
+static uint8_t i2cIndex = 0;
+static uint8_t i2cReading = 0;
+static uint8_t i2cRegPending = 0;
+static uint8_t i2cRetries = 0;
+
+/**
+ * Bit-rate settings for transfers without RDI2C_FAST or RDI2C_STANDARD.
+ */
+static uint8_t i2cTWBR = 0;
+static uint8_t i2cTWPS = 0;
+
+/**
+ * ms left before the active transfer times out.
+ */
+static volatile uint16_t i2cTimer = 0;
+
+/**
+ * Frees a bus held by a slave that lost track of the clock, by clocking SCL
+ * until it releases SDA and then sending a STOP. The TWI must be disabled.
+ *
+ * @return
+ *     1 if SDA is high afterwards, 0 if it is still held low.
+ */
+uint8_t RDI2CBusClear(void) {
+
+	// Both lines released (inputs with pull-ups), driven low through DDR
+	RDI2C_DDR &= ~((1 << RDI2C_SCL) | (1 << RDI2C_SDA));
+	RDI2C_PORT |= (1 << RDI2C_SCL) | (1 << RDI2C_SDA);
+	_delay_us(5);
+
+	for (uint8_t i = 0; i < 9 && !(RDI2C_PIN & (1 << RDI2C_SDA)); i++) {
+		RDI2C_PORT &= ~(1 << RDI2C_SCL);
+		RDI2C_DDR |= (1 << RDI2C_SCL);
+		_delay_us(5);
+		RDI2C_DDR &= ~(1 << RDI2C_SCL);
+		RDI2C_PORT |= (1 << RDI2C_SCL);
+		_delay_us(5);
+	}
+
+	// STOP: SDA rises while SCL is high
+	RDI2C_PORT &= ~(1 << RDI2C_SDA);
+	RDI2C_DDR |= (1 << RDI2C_SDA);
+	_delay_us(5);
+	RDI2C_DDR &= ~(1 << RDI2C_SDA);
+	RDI2C_PORT |= (1 << RDI2C_SDA);
+	_delay_us(5);
+
+	return (RDI2C_PIN & (1 << RDI2C_SDA)) != 0;
+}
+
+/**
+ * Initialises the TWI with raw bit-rate settings.
+ *
+ * @param twbr
+ *     TWBR value.
+ *
+ * @param twps
+ *     Prescaler bits TWPS1:0 (prescaler 1, 4, 16 or 64).
+ */
+void RDI2CInitTWBR(uint8_t twbr, uint8_t twps) {
+
+	// Free the bus in case a slave was left mid-byte by a reset
+	TWCR = 0;
+	RDI2CBusClear();
 
-void RDI2CInit(uint8_t scalef) {
-	
 	// Configure SCL
-	TWSR = 0x00;
-	TWBR = scalef;
+	i2cTWBR = twbr;
+	i2cTWPS = twps & 0x03;
+	TWSR = i2cTWPS;
+	TWBR = i2cTWBR;
 
 	// Enable I2C
-	TWCR |= (1 << TWEN) | (1 << TWIE);
-	
+	TWCR |= (1 << TWEN) | (1 << TWIE) | I2C_SLAVE_ACK;
+
 	sei();
 }
-static uint8_t I2CReady(void) {
 
-	return (RDI2CSM.buffer == NULL);
+void RDI2CInit(uint8_t scalef) {
+
+	RDI2CInitTWBR(scalef, 0);
 }
 
+/**
+ * RDI2CInitHz for a frequency only known at run time, kept out of line so
+ * the 32-bit divisions exist only once.
+ */
+static __attribute__((noinline)) uint32_t I2CInitHz(uint32_t hz) {
+
+	uint8_t twbr = RDI2C_TWBR(hz);
+	uint8_t twps = RDI2C_TWPS(hz);
+
+	RDI2CInitTWBR(twbr, twps);
+	return RDI2C_SCL_HZ(twbr, twps);
+}
+
+/**
+ * Initialises the TWI for a given SCL frequency. A constant hz folds to
+ * constants here; any other value is worked out by I2CInitHz.
+ *
+ * @param hz
+ *     Desired SCL frequency, e.g. 100000 or 400000.
+ *
+ * @return
+ *     SCL frequency achieved, at most hz when F_CPU allows.
+ */
+static inline __attribute__((always_inline))
+uint32_t RDI2CInitHz(uint32_t hz) {
+
+	if (!__builtin_constant_p(hz)) {
+		return I2CInitHz(hz);
+	}
+	RDI2CInitTWBR(RDI2C_TWBR(hz), RDI2C_TWPS(hz));
+	return RDI2C_SCL_HZ(RDI2C_TWBR(hz), RDI2C_TWPS(hz));
+}
+
+/**
+ * Gets the SCL frequency the TWI is currently set to.
+ *
+ * @return
+ *     SCL frequency in Hz.
+ */
+uint32_t RDI2CGetSCL(void) {
+
+	return RDI2C_SCL_HZ(TWBR, TWSR & 0x03);
+}
+
+/**
+ * Sets the bit-rate for a transfer, while the bus is between transfers.
+ */
+static void I2CSetSpeed(uint8_t flags) {
+
+	if (flags & RDI2C_FAST) {
+		TWSR = RDI2C_TWPS(400000UL);
+		TWBR = RDI2C_TWBR(400000UL);
+	} else if (flags & RDI2C_STANDARD) {
+		TWSR = RDI2C_TWPS(100000UL);
+		TWBR = RDI2C_TWBR(100000UL);
+	} else {
+		TWSR = i2cTWPS;
+		TWBR = i2cTWBR;
+	}
+}
+
+/**
+ * Rewinds the active transfer to its first byte.
+ */
+static void I2CRewind(void) {
+
+	i2cIndex = 0;
+	i2cRegPending = i2cActive->flags & RDI2C_REG;
+	i2cReading = (!i2cRegPending && i2cActive->txLength == 0 &&
+				  i2cActive->rxLength != 0);
+}
+
+/**
+ * Takes the next transfer off the queue and makes it active.
+ *
+ * @return
+ *     1 if there was one, 0 if the queue is empty.
+ */
+static uint8_t I2CNext(void) {
+
+	if (i2cQueueHead == i2cQueueTail) {
+		return 0;
+	}
+	uint8_t tail = (i2cQueueTail + 1) & RDI2C_QUEUE_MASK;
+	i2cActive = i2cQueue[tail];
+	i2cQueueTail = tail;
+	i2cRetries = 0;
+	i2cTimer = RDI2C_TIMEOUT_MS;
+	I2CSetSpeed(i2cActive->flags);
+	I2CRewind();
+	return 1;
+}
+
+/**
+ * Submits a transfer. Never waits.
+ *
+ * @param transfer
+ *     The transfer. Must not already be pending.
+ *
+ * @return
+ *     1 if queued, 0 if the queue is full.
+ */
+uint8_t RDI2CSubmit(RDI2CTransfer *transfer) {
+
+	uint8_t head = (i2cQueueHead + 1) & RDI2C_QUEUE_MASK;
+
+	if (head == i2cQueueTail) {
+		return 0;
+	}
+	transfer->status = RDI2C_PENDING;
+#ifdef RDI2C_STATS
+	transfer->submitted = i2cTime;
+#endif	// RDI2C_STATS
+	i2cQueue[head] = transfer;
+	i2cQueueHead = head;
+
+	// Start the bus if TWI_vect is not already working through the queue
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (i2cActive == NULL && I2CNext()) {
+#ifdef RDI2C_SLAVE
+			// Otherwise TWI_vect starts it when the master is done with us
+			if (!i2cSlaveBusy) {
+				I2CStart();
+			}
+#else
+			I2CStart();
+#endif	// RDI2C_SLAVE
+		}
+	}
+	return 1;
+}
+
+/**
+ * Reports the result of the active transfer. Runs in TWI_vect, or in
+ * RDI2CTick for RDI2C_TIMEOUT, with interrupts disabled in both cases.
+ *
+ * @param status
+ *     RDI2C_DONE, RDI2C_ERROR, RDI2C_NACK or RDI2C_TIMEOUT.
+ */
+static void I2CFinish(uint8_t status) {
+
+	RDI2CTransfer *transfer = i2cActive;
+
+#ifdef RDI2C_STATS
+	i2cStats.transfers++;
+	i2cStats.latency += (uint16_t) (i2cTime - transfer->submitted);
+	if (status == RDI2C_NACK) {
+		i2cStats.nacks++;
+	} else if (status == RDI2C_TIMEOUT) {
+		i2cStats.timeouts++;
+	} else if (status == RDI2C_ERROR) {
+		i2cStats.errors++;
+	}
+#endif	// RDI2C_STATS
+
+	transfer->status = status;
+	if (transfer->callback) {
+		transfer->callback(transfer);
+	}
+}
+
+/**
+ * Finishes the active transfer and starts the next one, if any.
+ *
+ * @param status
+ *     See I2CFinish.
+ */
+static void I2CComplete(uint8_t status) {
+
+	I2CFinish(status);
+
+	if (I2CNext()) {
+		// Stop, then start the next transfer straight away
+		I2CStopStart();
+	} else {
+		i2cActive = NULL;
+		I2CStop();
+	}
+}
+
+/**
+ * Advances the transfer timeout. Call this regularly, preferably from a
+ * timer interrupt; without it only transfers the blocking calls are waiting
+ * on time out, see ERROR RECOVERY. The callback of a transfer that times out
+ * is called from here, with interrupts disabled.
+ *
+ * @param elapsedMs
+ *     Milliseconds since the previous call.
+ */
+void RDI2CTick(uint16_t elapsedMs) {
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+#ifdef RDI2C_STATS
+		i2cTime += elapsedMs;
+#endif	// RDI2C_STATS
+		// While a master has us addressed, the active transfer is only
+		// waiting for the bus; its timer restarts once it gets it
+		if (i2cActive != NULL && !I2C_SLAVE_BUSY) {
+			if (elapsedMs < i2cTimer) {
+				i2cTimer -= elapsedMs;
+			} else {
+				// Reset the TWI and free the bus before moving on
+				TWCR = 0;
+				RDI2CBusClear();
+				TWCR = (1 << TWEN) | (1 << TWIE) | I2C_SLAVE_ACK;
+
+				I2CFinish(RDI2C_TIMEOUT);
+				if (I2CNext()) {
+					I2CStart();
+				} else {
+					i2cActive = NULL;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Waits about 10 us on behalf of a blocking call, advancing the timeout by
+ * 1 ms every 100 calls, so that a stuck bus cannot hang it.
+ *
+ * @param steps
+ *     Calls so far in this wait, 0 to start with.
+ */
+static void I2CWaitStep(uint8_t *steps) {
+
+	_delay_us(10);
+	if (++*steps == 100) {
+		*steps = 0;
+		RDI2CTick(1);
+	}
+}
+
+/**
+ * Waits for a submitted transfer to finish, advancing the timeout while it
+ * waits (see I2CWaitStep).
+ *
+ * @param transfer
+ *     The transfer.
+ *
+ * @return
+ *     Its status: RDI2C_DONE, RDI2C_NACK, RDI2C_ERROR or RDI2C_TIMEOUT.
+ */
+uint8_t RDI2CWait(RDI2CTransfer *transfer) {
+
+	uint8_t steps = 0;
+
+	while (transfer->status == RDI2C_PENDING) {
+		I2CWaitStep(&steps);
+	}
+	return transfer->status;
+}
+
+/**
+ * Submits a transfer, waiting for a free queue slot if needed, and advancing
+ * the timeout while it waits (see I2CWaitStep).
+ *
+ * @param transfer
+ *     The transfer. Must not already be pending.
+ */
+static void I2CSubmitWait(RDI2CTransfer *transfer) {
+
+	uint8_t steps = 0;
+
+	while (!RDI2CSubmit(transfer)) {
+		I2CWaitStep(&steps);
+	}
+}
+
+#ifdef RDI2C_STATS
+/**
+ * Gets a snapshot of the I2C statistics.
+ *
+ * @param stats
+ *     Where to copy the statistics.
+ */
+void RDI2CGetStats(RDI2CStats *stats) {
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*stats = *(RDI2CStats *) &i2cStats;
+	}
+}
+
+/**
+ * Gets the average time from submitting a transfer to it finishing.
+ *
+ * @return
+ *     Average latency in us, at the resolution of RDI2CTick.
+ */
+uint32_t RDI2CGetAverageLatency(void) {
+
+	RDI2CStats stats;
+
+	RDI2CGetStats(&stats);
+	return stats.transfers ? stats.latency * 1000 / stats.transfers : 0;
+}
+
+/**
+ * Resets all I2C statistics to zero.
+ */
+void RDI2CClearStats(void) {
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memset((RDI2CStats *) &i2cStats, 0, sizeof(i2cStats));
+	}
+}
+#endif	// RDI2C_STATS
+
 void RDI2CRead(uint8_t addr, uint8_t *buffer, uint8_t bufferLength) {
 
-	// Wait until interface becomes available
-	while (!I2CReady());
-	
-	// Set slave address and write mode
-	RDI2CSM.SLA_RW = (addr << 1) | 1;
-	
-	// Set burst (repeated) write mode
-	RDI2CSM.repeat = (bufferLength > 1);
-	
-	RDI2CSM.bufferLength = bufferLength;
-	
-	// Set buffer pointer to given buffer address
-	RDI2CSM.buffer = buffer;
-	
-	// Send start condition
-	I2CStart();
-	
-	// Wait for data to be read
-	while (!I2CReady());
+	RDI2CTransfer transfer = {
+		.addr = addr,
+		.rxBuffer = buffer,
+		.rxLength = bufferLength
+	};
+
+	// Wait for a free queue slot, then for the data to be read
+	I2CSubmitWait(&transfer);
+	RDI2CWait(&transfer);
+}
+
+/**
+ * Submits a write straight from the caller's buffer, which must stay valid
+ * until transfer->status is no longer RDI2C_PENDING.
+ *
+ * @param transfer
+ *     Descriptor to use; must not be pending. Its RDI2C_FAST,
+ *     RDI2C_STANDARD and RDI2C_NO_RETRY flags, if set, are kept.
+ *
+ * @param callback
+ *     Called from TWI_vect (RDI2CTick on a timeout) when the write has
+ *     finished, or NULL.
+ *
+ * @return
+ *     1 if queued, 0 if the queue is full.
+ */
+uint8_t RDI2CWriteAsync(RDI2CTransfer *transfer, uint8_t addr,
+						const uint8_t *buffer, uint8_t bufferLength,
+						void (*callback)(RDI2CTransfer *transfer)) {
+
+	transfer->addr = addr;
+	transfer->flags &= RDI2C_KEEP_FLAGS;
+	transfer->txBuffer = buffer;
+	transfer->txLength = bufferLength;
+	transfer->rxBuffer = NULL;
+	transfer->rxLength = 0;
+	transfer->callback = callback;
+
+	return RDI2CSubmit(transfer);
+}
+
+#ifndef RDI2C_DYNAMIC
+/**
+ * Transfer used by RDI2CWrite, which returns before the data is sent.
+ */
+static RDI2CTransfer i2cWriteTransfer;
+#else
+/**
+ * Pool block: a copied write and its descriptor. The main program claims a
+ * block by setting used; TWI_vect clears it once the write has been sent.
+ */
+typedef struct {
+
+	RDI2CTransfer transfer;			// Must be first, see I2CPoolFree
+	volatile uint8_t used;
+	uint8_t data[RDI2C_POOL_BLOCK_SIZE];
+} I2CPoolBlock;
+
+static I2CPoolBlock i2cPool[RDI2C_POOL_BLOCKS];
+
+static void I2CPoolFree(RDI2CTransfer *transfer) {
+
+	((I2CPoolBlock *) transfer)->used = 0;
 }
 
+/**
+ * Claims a free pool block, waiting for TWI_vect to release one if needed.
+ */
+static I2CPoolBlock *I2CPoolAlloc(void) {
+
+	uint8_t i = 0;
+	uint8_t steps = 0;
+
+	while (i2cPool[i].used) {
+		i = (i + 1) % RDI2C_POOL_BLOCKS;
+		if (i == 0) {
+			I2CWaitStep(&steps);
+		}
+	}
+	i2cPool[i].used = 1;
+	return &i2cPool[i];
+}
+#endif	// RDI2C_DYNAMIC
+
 int8_t RDI2CWrite(uint8_t addr, uint8_t *buffer, uint8_t bufferLength) {
-	
-	// Wait until interface becomes available
-	while (!I2CReady());
-	
+
+	RDI2CTransfer *transfer;
+	uint8_t *copy;
+
 #ifndef RDI2C_DYNAMIC
 	if (bufferLength > RDI2C_BUFFER_SIZE) return -1;
-	RDI2CSM.buffer = staticBuffer;
-	RDI2CSM.bufferLength = RDI2C_BUFFER_SIZE;
+
+	// Wait until the previous write has been sent
+	RDI2CWait(&i2cWriteTransfer);
+	transfer = &i2cWriteTransfer;
+	copy = staticBuffer;
 #else
-	// Allocate memory
-	RDI2CSM.buffer = malloc(bufferLength * sizeof(uint8_t));
-	if (RDI2CSM.buffer == NULL) return -1;
-	RDI2CSM.bufferLength = bufferLength;
+	if (bufferLength > RDI2C_POOL_BLOCK_SIZE) return -1;
+
+	I2CPoolBlock *block = I2CPoolAlloc();
+	transfer = &block->transfer;
+	copy = block->data;
 #endif	// RDI2C_DYNAMIC
 
 	// Copy data into transmit buffer
-	memcpy(RDI2CSM.buffer, buffer, bufferLength);
-	
-	// Set slave address and write mode
-	RDI2CSM.SLA_RW = (addr << 1);
-	
-	// Set burst (repeated) write mode
-	RDI2CSM.repeat = (bufferLength > 1);
-	
-	// Send start condition
-	I2CStart();
-	
+	memcpy(copy, buffer, bufferLength);
+
+	uint8_t steps = 0;
+
+#ifndef RDI2C_DYNAMIC
+	while (!RDI2CWriteAsync(transfer, addr, copy, bufferLength, NULL)) {
+		I2CWaitStep(&steps);
+	}
+#else
+	while (!RDI2CWriteAsync(transfer, addr, copy, bufferLength, I2CPoolFree)) {
+		I2CWaitStep(&steps);
+	}
+#endif	// RDI2C_DYNAMIC
+
+	return 0;
+}
+
+/**
+ * Submits a register read: writes reg, then reads bufferLength bytes after a
+ * repeated start.
+ *
+ * @param transfer
+ *     Descriptor to use; must not be pending. Its RDI2C_FAST,
+ *     RDI2C_STANDARD and RDI2C_NO_RETRY flags, if set, are kept.
+ *
+ * @param callback
+ *     Called from TWI_vect (RDI2CTick on a timeout) when the read has
+ *     finished, or NULL.
+ *
+ * @return
+ *     1 if queued, 0 if the queue is full.
+ */
+uint8_t RDI2CReadRegAsync(RDI2CTransfer *transfer, uint8_t addr, uint8_t reg,
+						  uint8_t *buffer, uint8_t bufferLength,
+						  void (*callback)(RDI2CTransfer *transfer)) {
+
+	transfer->addr = addr;
+	transfer->flags = (transfer->flags & RDI2C_KEEP_FLAGS) | RDI2C_REG;
+	transfer->reg = reg;
+	transfer->txBuffer = NULL;
+	transfer->txLength = 0;
+	transfer->rxBuffer = buffer;
+	transfer->rxLength = bufferLength;
+	transfer->callback = callback;
+
+	return RDI2CSubmit(transfer);
+}
+
+/**
+ * Submits a register write: writes reg followed by bufferLength bytes
+ * straight from buffer, which must stay valid until the write has finished.
+ *
+ * @param transfer
+ *     Descriptor to use; must not be pending. Its RDI2C_FAST,
+ *     RDI2C_STANDARD and RDI2C_NO_RETRY flags, if set, are kept.
+ *
+ * @param callback
+ *     Called from TWI_vect (RDI2CTick on a timeout) when the write has
+ *     finished, or NULL.
+ *
+ * @return
+ *     1 if queued, 0 if the queue is full.
+ */
+uint8_t RDI2CWriteRegAsync(RDI2CTransfer *transfer, uint8_t addr, uint8_t reg,
+						   const uint8_t *buffer, uint8_t bufferLength,
+						   void (*callback)(RDI2CTransfer *transfer)) {
+
+	transfer->addr = addr;
+	transfer->flags = (transfer->flags & RDI2C_KEEP_FLAGS) | RDI2C_REG;
+	transfer->reg = reg;
+	transfer->txBuffer = buffer;
+	transfer->txLength = bufferLength;
+	transfer->rxBuffer = NULL;
+	transfer->rxLength = 0;
+	transfer->callback = callback;
+
+	return RDI2CSubmit(transfer);
+}
+
+/**
+ * Reads bufferLength bytes starting at register reg, waiting until done.
+ *
+ * @return
+ *     RDI2C_DONE on success,
+ *     RDI2C_NACK if the slave did not acknowledge its address,
+ *     RDI2C_ERROR if the slave refused data or the bus misbehaved,
+ *     RDI2C_TIMEOUT if the transfer timed out.
+ */
+uint8_t RDI2CReadReg(uint8_t addr, uint8_t reg, uint8_t *buffer,
+					 uint8_t bufferLength) {
+
+	RDI2CTransfer transfer = {0};
+	uint8_t steps = 0;
+
+	while (!RDI2CReadRegAsync(&transfer, addr, reg, buffer, bufferLength, NULL)) {
+		I2CWaitStep(&steps);
+	}
+	return RDI2CWait(&transfer);
+}
+
+/**
+ * Writes bufferLength bytes starting at register reg, waiting until done.
+ *
+ * @return
+ *     RDI2C_DONE on success,
+ *     RDI2C_NACK if the slave did not acknowledge its address,
+ *     RDI2C_ERROR if the slave refused data or the bus misbehaved,
+ *     RDI2C_TIMEOUT if the transfer timed out.
+ */
+uint8_t RDI2CWriteReg(uint8_t addr, uint8_t reg, const uint8_t *buffer,
+					  uint8_t bufferLength) {
+
+	RDI2CTransfer transfer = {0};
+	uint8_t steps = 0;
+
+	while (!RDI2CWriteRegAsync(&transfer, addr, reg, buffer, bufferLength, NULL)) {
+		I2CWaitStep(&steps);
+	}
+	return RDI2CWait(&transfer);
+}
+
+#ifdef RDI2C_SLAVE
+/**
+ * Enables slave mode. The TWI answers addr while it is not busy as a
+ * master.
+ *
+ * @param addr
+ *     7-bit slave address.
+ *
+ * @param onWrite
+ *     Called from TWI_vect with the first register and the number of
+ *     registers after a master has written some, or NULL.
+ */
+void RDI2CSlaveInit(uint8_t addr, void (*onWrite)(uint8_t reg, uint8_t length)) {
+
+	i2cSlaveOnWrite = onWrite;
+	i2cSlaveAck = (1 << TWEA);
+	TWAR = addr << 1;
+	TWCR = (1 << TWEN) | (1 << TWIE) | (1 << TWEA);
+
+	sei();
+}
+
+/**
+ * Gets the shadow register file, where the program prepares the next values
+ * for RDI2CSlaveCommit. Registers written by a master appear here too.
+ *
+ * @return
+ *     Pointer to RDI2C_SLAVE_REGS bytes.
+ */
+volatile uint8_t *RDI2CSlaveShadow(void) {
+
+	return i2cSlaveShadow;
+}
+
+/**
+ * Copies the shadow registers to the registers masters read.
+ */
+static void I2CSlavePublish(void) {
+
+	for (uint16_t i = 0; i < RDI2C_SLAVE_REGS; i++) {
+		i2cSlaveRegs[i] = i2cSlaveShadow[i];
+	}
+	i2cSlaveCommitPending = 0;
+}
+
+/**
+ * Publishes the shadow registers to masters, all at once. If a master is
+ * reading, they are published when it has finished.
+ */
+void RDI2CSlaveCommit(void) {
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (i2cSlaveReading) {
+			i2cSlaveCommitPending = 1;
+		} else {
+			I2CSlavePublish();
+		}
+	}
+}
+
+/**
+ * Reads a register as masters see it.
+ *
+ * @param reg
+ *     Register number.
+ *
+ * @return
+ *     Register value.
+ */
+uint8_t RDI2CSlaveRead(uint8_t reg) {
+
+	return i2cSlaveRegs[reg % RDI2C_SLAVE_REGS];
+}
+
+/**
+ * Handles the slave states of TWI_vect.
+ *
+ * @return
+ *     1 if status was a slave state, 0 otherwise.
+ */
+static uint8_t I2CSlaveISR(uint8_t status) {
+
+	if (status == SR_ARBIT_SLA_W || status == ST_ARBIT_SLA_R) {
+
+		// Lost the bus to a master addressing us; our own transfer starts
+		// over once it has finished
+		if (i2cActive != NULL) {
+			I2CRewind();
+		}
+		status = (status == SR_ARBIT_SLA_W) ? SR_SLA_W_ACK : ST_SLA_R_ACK;
+	}
+
+	switch (status) {
+
+		case SR_SLA_W_ACK:	// Addressed for writing
+
+			i2cSlaveBusy = 1;
+			i2cSlaveFirst = 1;
+			i2cSlaveWritten = 0;
+			I2CACK();
+			return 1;
+
+		case SR_DATAR_ACK:	// Register byte received
+		case SR_DATAR_NACK:
+
+			if (i2cSlaveFirst) {
+				i2cSlavePointer = TWDR % RDI2C_SLAVE_REGS;
+				i2cSlaveStart = i2cSlavePointer;
+				i2cSlaveFirst = 0;
+			} else {
+				i2cSlaveRegs[i2cSlavePointer] = TWDR;
+				i2cSlaveShadow[i2cSlavePointer] = i2cSlaveRegs[i2cSlavePointer];
+				i2cSlavePointer = (i2cSlavePointer + 1) % RDI2C_SLAVE_REGS;
+				++i2cSlaveWritten;
+			}
+			I2CACK();
+			return 1;
+
+		case ST_SLA_R_ACK:	// Addressed for reading
+
+			i2cSlaveBusy = 1;
+			i2cSlaveReading = 1;
+			// Fall through
+		case ST_DATAT_ACK:	// Register byte sent, master wants more
+
+			TWDR = i2cSlaveRegs[i2cSlavePointer];
+			i2cSlavePointer = (i2cSlavePointer + 1) % RDI2C_SLAVE_REGS;
+			I2CACK();
+			return 1;
+
+		case SR_STOP:		// STOP or repeated START
+		case ST_DATAT_NACK:	// Master has read enough
+		case ST_LAST_DATAT:
+
+			if (i2cSlaveWritten && i2cSlaveOnWrite) {
+				i2cSlaveOnWrite(i2cSlaveStart, i2cSlaveWritten);
+			}
+			i2cSlaveWritten = 0;
+			i2cSlaveBusy = 0;
+			i2cSlaveReading = 0;
+			if (i2cSlaveCommitPending) {
+				I2CSlavePublish();
+			}
+
+			// Stay addressable, and start any waiting master transfer
+			if (i2cActive != NULL) {
+				i2cTimer = RDI2C_TIMEOUT_MS;
+				I2CStart();
+			} else {
+				I2CACK();
+			}
+			return 1;
+	}
 	return 0;
 }
+#endif	// RDI2C_SLAVE
 
 ISR(TWI_vect) {
 
+	RDI2CTransfer *transfer = i2cActive;
+
+#ifdef RDI2C_SLAVE
+	if (I2CSlaveISR(I2C_STATUS)) {
+		return;
+	}
+#endif	// RDI2C_SLAVE
+
+	if (transfer == NULL) {
+		// Nothing to do; release the bus
+		I2CStop();
+		return;
+	}
+
 	switch (I2C_STATUS) {
-	
+
 		case START_SENT:	// Start condition sent
-			
+		case REP_START_SENT:	// Repeated start condition sent
+
 			// Copy slave address and access type to TWDR
-			TWDR = RDI2CSM.SLA_RW;
+			TWDR = (transfer->addr << 1) | i2cReading;
 			I2CContinue();
 			break;
-		
+
+		case MT_DATAT_ACK:	// Data transmitted, ACK received
+#ifdef RDI2C_STATS
+			i2cStats.bytes++;
+#endif	// RDI2C_STATS
+			// Fall through
 		case MT_SLA_W_ACK:	// Write request acknowledged
-			
-			// Copy data to TWDR
-			TWDR = RDI2CSM.buffer[RDI2CSM.bufferIndex];
-			++RDI2CSM.bufferIndex;
-			I2CContinue();
+
+			if (i2cRegPending) {
+
+				// Register pointer goes first
+				TWDR = transfer->reg;
+				i2cRegPending = 0;
+				I2CContinue();
+
+			} else if (i2cIndex < transfer->txLength) {
+
+				// Copy data to TWDR
+				TWDR = transfer->txBuffer[i2cIndex];
+				++i2cIndex;
+				I2CContinue();
+
+			} else if (transfer->rxLength) {
+
+				// Turn the bus around for the read
+				i2cReading = 1;
+				i2cIndex = 0;
+				I2CStart();
+
+			} else {
+				I2CComplete(RDI2C_DONE);
+			}
 			break;
-			
+
 		case MT_SLA_W_NACK:	// Write request declined
 		case MR_SLA_R_NACK:	// Read request declined
-	
-			I2CStart();
-			break;
-			
-		case MR_SLA_R_ACK:	// Read request acknowledged
-			
-			// Copy TWDR to buffer
-			RDI2CSM.buffer[RDI2CSM.bufferIndex] = TWDR;
-			++RDI2CSM.bufferIndex;
-			I2CACK();
+
+			// Slave busy or absent; try again a few times
+			if (!(i2cActive->flags & RDI2C_NO_RETRY) &&
+					i2cRetries < RDI2C_MAX_RETRIES) {
+				++i2cRetries;
+				I2CRewind();
+				I2CStopStart();
+			} else {
+				I2CComplete(RDI2C_NACK);
+			}
 			break;
-					
-		case MT_DATAT_ACK:	// Data transmitted, ACK received
-			
-			// If there is still data to be transmitted
-			if (RDI2CSM.repeat && (RDI2CSM.bufferIndex < RDI2CSM.bufferLength)) {
-				
-				// Send repeated start condition
+
+		case MT_DATAT_NACK:	// Data transmitted, NACK received
+#ifdef RDI2C_STATS
+			i2cStats.bytes++;
+#endif	// RDI2C_STATS
+
+			// Only an error if the slave refused data still to come
+			if (i2cRegPending || i2cIndex < transfer->txLength) {
+				I2CComplete(RDI2C_ERROR);
+			} else if (transfer->rxLength) {
+				i2cReading = 1;
+				i2cIndex = 0;
 				I2CStart();
 			} else {
-				
-#ifdef RDI2C_DYNAMIC
-				// Deallocate memory
-				free(RDI2CSM.buffer);
-#endif // RDI2C_DYNAMIC
-				RDI2CSM.buffer = NULL;
-				RDI2CSM.bufferIndex = 0;
-				
-				// Send stop condition
-				I2CStop();
+				I2CComplete(RDI2C_DONE);
 			}
-			
-			I2CContinue();
 			break;
-			
-		case MT_DATAT_NACK:	// Data transmitted, NACK received
-		
-#ifdef RDI2C_DYNAMIC
-			// Deallocate memory
-			free(RDI2CSM.buffer);
-#endif // RDI2C_DYNAMIC
-			RDI2CSM.buffer = NULL;
-			RDI2CSM.bufferIndex = 0;
-			
-			// Send stop condition
-			I2CStop();
+
+		case MR_SLA_R_ACK:	// Read request acknowledged
+
+			// NACK the last byte to end the read
+			if (transfer->rxLength > 1) {
+				I2CACK();
+			} else {
+				I2CNACK();
+			}
 			break;
-			
+
 		case MR_DATAR_ACK:	// Data received, ACK transmitted
-			
-			// If there is still data to be received
-			if (RDI2CSM.repeat && (RDI2CSM.bufferIndex < RDI2CSM.bufferLength)) {
-				
-				// Send repeated start condition
-				I2CStart();
+
+			// Copy TWDR to buffer
+			transfer->rxBuffer[i2cIndex] = TWDR;
+			++i2cIndex;
+#ifdef RDI2C_STATS
+			i2cStats.bytes++;
+#endif	// RDI2C_STATS
+
+			if (i2cIndex < transfer->rxLength - 1) {
+				I2CACK();
 			} else {
-				
-				// Send NACK
 				I2CNACK();
 			}
-			
-			I2CContinue();
 			break;
-			
+
 		case MR_DATAR_NACK: // Data received, NACK transmitted
 
-			// Clear buffer pointer
-			RDI2CSM.buffer = NULL;
-			RDI2CSM.bufferIndex = 0;
-
-			I2CStop();
-			
-		case REP_START_SENT:
-			
-			if (RDI2CSM.SLA_RW & 1) {
-				
-				// Read operations
-				RDI2CSM.buffer[RDI2CSM.bufferIndex] = TWDR;
-				++RDI2CSM.bufferIndex;
-				I2CACK();
-				
+			// Copy the last byte to buffer
+			transfer->rxBuffer[i2cIndex] = TWDR;
+			++i2cIndex;
+#ifdef RDI2C_STATS
+			i2cStats.bytes++;
+#endif	// RDI2C_STATS
+			I2CComplete(RDI2C_DONE);
+			break;
+
+		case ARBIT_LOST:	// Another master won the bus
+
+#ifdef RDI2C_STATS
+			i2cStats.arbitrationLosses++;
+#endif	// RDI2C_STATS
+
+			// Start again once the bus is free
+			if (i2cRetries < RDI2C_MAX_RETRIES) {
+				++i2cRetries;
+				I2CRewind();
+				I2CStart();
 			} else {
-			
-				// Copy data to TWDR
-				TWDR = RDI2CSM.buffer[RDI2CSM.bufferIndex];
-				++RDI2CSM.bufferIndex;
-				I2CContinue();
+				I2CComplete(RDI2C_ERROR);
 			}
 			break;
-		
+
 		default:
-			
-			I2CContinue();
+
+			I2CComplete(RDI2C_ERROR);
 			break;
 	}
 }
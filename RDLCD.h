@@ -8,9 +8,11 @@
  */
 
 #include <avr/io.h>
+#include <string.h>
 
 // Ascii font data
 #include "RDASCIIFont.h"
+#include "RDConfig.h"
 
 #ifndef RDLCD_H_
 /**
@@ -18,6 +20,29 @@
  */
 #define RDLCD_H_
 
+/*
+ * Uncomment to draw into a framebuffer in RAM (RDLCD_BANKS * RDLCD_W bytes)
+ * instead of the display. RDLCDClear, RDLCDCharacter, RDLCDString and
+ * RDLCDPosition then only change RAM, and RDLCDFlush sends the columns that
+ * changed since the last flush, one span per bank.
+ */
+// #define RDLCD_FRAMEBUFFER
+
+/*
+ * Uncomment to send frames in the background with RDLCDFlushAsync. Needs a
+ * second RDLCD_BANKS * RDLCD_W byte buffer holding the frame being sent, so
+ * drawing the next frame cannot tear it. Implies RDLCD_FRAMEBUFFER, and uses
+ * SPI_STC_vect (RDSPI_ASYNC), so interrupts must be enabled with sei().
+ */
+// #define RDLCD_ASYNC
+
+#ifdef RDLCD_ASYNC
+#ifndef RDLCD_FRAMEBUFFER
+#define RDLCD_FRAMEBUFFER
+#endif // RDLCD_FRAMEBUFFER
+#define RDSPI_ASYNC
+#endif // RDLCD_ASYNC
+
 /**
  * Setting for whether the mode will be master (1) or slave (0).
  */
@@ -29,6 +54,11 @@
  */
 #define RDLCD_FONT_W 5
 
+/**
+ * LCD Character Width, the font plus a blank column either side.
+ */
+#define RDLCD_CHAR_W (RDLCD_FONT_W + 2)
+
 /************
  * LCD pins *
  ************/
@@ -121,6 +151,14 @@
  */
 #define LCD_CLK_PS	0
 
+/**
+ * Fastest SPI clock the LCD controller (PCD8544) allows. Its rated limit is
+ * 4 MHz; define as (F_CPU / 2) to run bursts faster on modules that cope.
+ */
+#ifndef RDLCD_SPI_HZ
+#define RDLCD_SPI_HZ	4000000UL
+#endif // RDLCD_SPI_HZ
+
 /*******************
  * LCD Parameters. *
  *******************/
@@ -150,6 +188,11 @@
  */
 #define RDLCD_ROW_H     8
 
+/**
+ * LCD Number of 8-pixel Banks (the PCD8544's Y addresses).
+ */
+#define RDLCD_BANKS     (RDLCD_H / 8)
+
 /**
  * LCD Default Contrast.
  */
@@ -164,6 +207,50 @@
  * LCD Functions. *
  ******************/
 
+/**
+ * The LCD as an SPI device: mode 0, MSB first.
+ */
+static const RDSPIDevice RDLCDDevice =
+    RDSPI_DEVICE(RDLCD_PORT, RDLCD_CS, 0, 0, RDLCD_SPI_HZ);
+
+#ifdef RDLCD_ASYNC
+
+/**
+ * 1 while RDLCDFlushAsync is sending a frame.
+ */
+static volatile uint8_t lcdInFlight = 0;
+
+/**
+ * Checks whether a frame is still being sent in the background. The frame
+ * keeps the SPI bus from its first span to its last: a transaction with
+ * another device (RDSPIBeginDevice, RDSPIBeginTransaction, RDSPIRWByte)
+ * waits until it is done.
+ *
+ * @return
+ *     1 if busy, 0 if done.
+ */
+uint8_t RDLCDBusy(void) {
+    return lcdInFlight;
+}
+
+#endif // RDLCD_ASYNC
+
+/**
+ * Starts a burst to the LCD screen: sets data/command mode once and holds
+ * chip select low until RDSPIEndTransaction. Waits for a frame being sent
+ * in the background first.
+ *
+ * @param dc
+ *     Whether the burst is commands (0) or pixel-data (1).
+ */
+static inline void RDLCDBegin(uint8_t dc) {
+#ifdef RDLCD_ASYNC
+    while (lcdInFlight);
+#endif // RDLCD_ASYNC
+    RDLCD_PORT = (RDLCD_PORT & ~(1 << RDLCD_DC)) | (dc << RDLCD_DC);
+    RDSPIBeginDevice(&RDLCDDevice);
+}
+
 /**
  * Writes a byte of pixel-data or a command to LCD screen.
  * 
@@ -175,12 +262,230 @@
  *     pixel-data (1).
  */
 void RDLCDWrite(uint8_t byte, uint8_t dc) {
-	// Set data/command mode
-	RDLCD_PORT = (RDLCD_PORT & ~(1 << RDLCD_DC)) | (dc << RDLCD_DC);
+	// Set data/command mode and select the LCD
+	RDLCDBegin(dc);
 	// Write byte to SPI
-	RDSPIRWByte(byte, 5, &RDLCD_PORT, RDLCD_CS);
+	RDSPITransfer(byte);
+	RDSPIEndTransaction();
+}
+
+/**
+ * Writes a buffer of pixel-data or commands to the LCD screen in one burst.
+ *
+ * @param data
+ *     Pointer to buffer.
+ *
+ * @param length
+ *     The length of the buffer.
+ *
+ * @param dc
+ *     Whether the buffer holds commands (0) or pixel-data (1).
+ */
+void RDLCDWriteBuffer(const uint8_t *data, uint16_t length, uint8_t dc) {
+    RDLCDBegin(dc);
+    RDSPIWriteBuffer(data, length);
+    RDSPIEndTransaction();
+}
+
+/**
+ * Builds the columns of a character, padding included.
+ *
+ * @param glyph
+ *     Where to store the RDLCD_CHAR_W columns.
+ *
+ * @param character
+ *     The character.
+ */
+static inline void RDLCDGlyph(uint8_t *glyph, unsigned char character) {
+    glyph[0] = 0x00;
+    memcpy(glyph + 1, ASCII[character - 0x20], RDLCD_FONT_W);
+    glyph[RDLCD_CHAR_W - 1] = 0x00;
+}
+
+#ifdef RDLCD_FRAMEBUFFER
+
+/**
+ * Framebuffer, one byte per column of each bank (LSB at the top). Code that
+ * draws into it directly must pass the columns it changes to RDLCDMarkDirty.
+ */
+static uint8_t lcdFrame[RDLCD_BANKS][RDLCD_W];
+
+/**
+ * Changed columns of each bank since the last flush; clean when min > max.
+ */
+static uint8_t lcdDirtyMin[RDLCD_BANKS];
+static uint8_t lcdDirtyMax[RDLCD_BANKS];
+
+/**
+ * Framebuffer cursor, see RDLCDPosition.
+ */
+static uint8_t lcdX = 0;
+static uint8_t lcdBank = 0;
+
+/**
+ * Marks columns of a bank as needing to be sent by RDLCDFlush.
+ *
+ * @param bank
+ *     The bank (0 - RDLCD_BANKS - 1).
+ *
+ * @param x0
+ *     First column.
+ *
+ * @param x1
+ *     Last column, not less than x0.
+ */
+static inline void RDLCDMarkDirty(uint8_t bank, uint8_t x0, uint8_t x1) {
+    if (x0 < lcdDirtyMin[bank]) {
+        lcdDirtyMin[bank] = x0;
+    }
+    if (x1 > lcdDirtyMax[bank]) {
+        lcdDirtyMax[bank] = x1;
+    }
 }
 
+/**
+ * Writes a byte of pixel-data to the framebuffer at the cursor and advances
+ * it the way the display does: to the next column, then the next bank.
+ *
+ * @param byte
+ *     The byte of pixel-data.
+ */
+static void RDLCDFramePut(uint8_t byte) {
+    uint8_t *cell = &lcdFrame[lcdBank][lcdX];
+
+    if (*cell != byte) {
+        *cell = byte;
+        RDLCDMarkDirty(lcdBank, lcdX, lcdX);
+    }
+    if (++lcdX == RDLCD_W) {
+        lcdX = 0;
+        if (++lcdBank == RDLCD_BANKS) {
+            lcdBank = 0;
+        }
+    }
+}
+
+/**
+ * Sends the columns of the framebuffer that changed since the last flush to
+ * the LCD screen.
+ *
+ * @return
+ *     Number of bytes of pixel-data sent.
+ */
+uint16_t RDLCDFlush(void) {
+    uint16_t sent = 0;
+
+    for (uint8_t bank = 0; bank < RDLCD_BANKS; bank++) {
+        uint8_t x = lcdDirtyMin[bank];
+        uint8_t last = lcdDirtyMax[bank];
+        uint8_t position[2];
+
+        if (x > last) {
+            continue;
+        }
+        lcdDirtyMin[bank] = 0xFF;
+        lcdDirtyMax[bank] = 0;
+
+        position[0] = LCD_SET_X | x;
+        position[1] = LCD_SET_Y | bank;
+        RDLCDWriteBuffer(position, 2, RDLCD_C);
+        RDLCDWriteBuffer(&lcdFrame[bank][x], last - x + 1, RDLCD_D);
+        sent += last - x + 1;
+    }
+    return sent;
+}
+
+#ifdef RDLCD_ASYNC
+
+/**
+ * The frame being sent and its spans, copied from lcdFrame/lcdDirty* by
+ * RDLCDFlushAsync.
+ */
+static uint8_t lcdSendFrame[RDLCD_BANKS][RDLCD_W];
+static uint8_t lcdSendMin[RDLCD_BANKS];
+static uint8_t lcdSendMax[RDLCD_BANKS];
+
+/**
+ * Next bank of lcdSendFrame to look for a span in.
+ */
+static uint8_t lcdSendBank;
+
+/**
+ * Positions the display at the next span of lcdSendFrame and starts sending
+ * it; runs again from SPI_STC_vect when the span is done, with interrupts
+ * still disabled, since RDSPITransferAsync leaves them alone. The next span
+ * is started before SPI_STC_vect returns, so RDSPIBusy stays 1, and other
+ * devices stay off the bus, until the last span is done.
+ */
+static void RDLCDSendSpan(void) {
+    uint8_t bank;
+    uint8_t x;
+
+    // Release chip select after the previous span
+    RDSPIEndTransaction();
+    while (lcdSendBank < RDLCD_BANKS &&
+            lcdSendMin[lcdSendBank] > lcdSendMax[lcdSendBank]) {
+        lcdSendBank++;
+    }
+    if (lcdSendBank == RDLCD_BANKS) {
+        lcdInFlight = 0;
+        return;
+    }
+    bank = lcdSendBank++;
+    x = lcdSendMin[bank];
+
+    // RDLCDBegin would wait for this frame
+    RDLCD_PORT &= ~(1 << RDLCD_DC);
+    RDSPIBeginDevice(&RDLCDDevice);
+    RDSPITransfer(LCD_SET_X | x);
+    RDSPITransfer(LCD_SET_Y | bank);
+    RDLCD_PORT |= (1 << RDLCD_DC);
+    RDSPITransferAsync(&lcdSendFrame[bank][x], NULL,
+                       lcdSendMax[bank] - x + 1, RDLCDSendSpan);
+}
+
+/**
+ * Starts sending the columns of the framebuffer that changed since the last
+ * flush in the background, returning at once. They are copied first, so
+ * drawing can carry on while they are sent.
+ *
+ * @return
+ *     Number of bytes of pixel-data queued,
+ *     0 if nothing changed or the previous frame is still being sent.
+ */
+uint16_t RDLCDFlushAsync(void) {
+    uint16_t queued = 0;
+
+    if (lcdInFlight) {
+        return 0;
+    }
+    for (uint8_t bank = 0; bank < RDLCD_BANKS; bank++) {
+        uint8_t x = lcdDirtyMin[bank];
+        uint8_t last = lcdDirtyMax[bank];
+
+        lcdSendMin[bank] = x;
+        lcdSendMax[bank] = last;
+        if (x > last) {
+            continue;
+        }
+        lcdDirtyMin[bank] = 0xFF;
+        lcdDirtyMax[bank] = 0;
+
+        memcpy(&lcdSendFrame[bank][x], &lcdFrame[bank][x], last - x + 1);
+        queued += last - x + 1;
+    }
+    if (queued) {
+        lcdInFlight = 1;
+        lcdSendBank = 0;
+        RDLCDSendSpan();
+    }
+    return queued;
+}
+
+#endif // RDLCD_ASYNC
+
+#endif // RDLCD_FRAMEBUFFER
+
 /**
  * Initialises the LCD screen.
  */
@@ -197,8 +502,8 @@ void RDLCDInit(void) {
 	RDSPIInit(0,0);
     // Use extended instruction set
     RDLCDWrite(LCD_EXT_FN, RDLCD_C);
-    // Set default contrast
-    RDLCDWrite(LCD_SET_CONTRAST | RDLCD_DEFAULT_CONTRAST, RDLCD_C);
+    // Set stored contrast (RDLCD_DEFAULT_CONTRAST unless changed)
+    RDLCDWrite(LCD_SET_CONTRAST | RDConfigGet()->lcdContrast, RDLCD_C);
     // Use basic instruction set
     RDLCDWrite(LCD_BSC_FN, RDLCD_C);
     //Set LCD to normal mode
@@ -207,16 +512,49 @@ void RDLCDInit(void) {
     //Reset the LCD position
     RDLCDWrite(LCD_SET_X | 0x00, RDLCD_C);
     RDLCDWrite(LCD_SET_Y | 0x00, RDLCD_C);
-    
+
+#ifdef RDLCD_FRAMEBUFFER
+    // The display's RAM is undefined after reset, so the first flush sends
+    // the whole (blank) frame
+    memset(lcdFrame, 0, sizeof(lcdFrame));
+    memset(lcdDirtyMin, 0, sizeof(lcdDirtyMin));
+    memset(lcdDirtyMax, RDLCD_W - 1, sizeof(lcdDirtyMax));
+    lcdX = 0;
+    lcdBank = 0;
+#endif // RDLCD_FRAMEBUFFER
+}
+
+/**
+ * Sets the LCD contrast. The value is kept in the config so that
+ * RDConfigSave makes it the contrast RDLCDInit uses.
+ *
+ * @param contrast
+ *     The contrast (0x00 - 0x7F), e.g. RDLCD_DEFAULT_CONTRAST.
+ */
+void RDLCDSetContrast(uint8_t contrast) {
+    contrast &= 0x7F;
+    RDConfigGet()->lcdContrast = contrast;
+    // Use extended instruction set
+    RDLCDWrite(LCD_EXT_FN, RDLCD_C);
+    RDLCDWrite(LCD_SET_CONTRAST | contrast, RDLCD_C);
+    // Use basic instruction set
+    RDLCDWrite(LCD_BSC_FN, RDLCD_C);
 }
 
 /**
  * Clears the LCD screen.
  */
 void RDLCDClear(void) {
-    for (int i = 0; i < RDLCD_W * RDLCD_ROW_H; i++){
-        RDLCDWrite(0x00, RDLCD_D);
+#ifdef RDLCD_FRAMEBUFFER
+    for (uint16_t i = 0; i < RDLCD_BANKS * RDLCD_W; i++) {
+        RDLCDFramePut(0x00);
     }
+#else
+    // A whole frame leaves the cursor where it was
+    RDLCDBegin(RDLCD_D);
+    RDSPIWriteRepeat(0x00, RDLCD_BANKS * RDLCD_W);
+    RDSPIEndTransaction();
+#endif // RDLCD_FRAMEBUFFER
 }
 
 /**
@@ -226,13 +564,16 @@ void RDLCDClear(void) {
  *     The character to be written to the LCD screen.
  */
 void RDLCDCharacter(unsigned char character) {
-    // Clear padding between each character
-    RDLCDWrite(0x00, RDLCD_D);
-    for (int i = 0; i < RDLCD_FONT_W; i++)
-    {
-        RDLCDWrite(ASCII[character - 0x20][i], RDLCD_D);
+    uint8_t glyph[RDLCD_CHAR_W];
+
+    RDLCDGlyph(glyph, character);
+#ifdef RDLCD_FRAMEBUFFER
+    for (uint8_t i = 0; i < RDLCD_CHAR_W; i++) {
+        RDLCDFramePut(glyph[i]);
     }
-    RDLCDWrite(0x00, RDLCD_D);
+#else
+    RDLCDWriteBuffer(glyph, RDLCD_CHAR_W, RDLCD_D);
+#endif // RDLCD_FRAMEBUFFER
 }
 
 /**
@@ -243,10 +584,23 @@ void RDLCDCharacter(unsigned char character) {
  *     The string to be written to the LCD screen.
  */
 void RDLCDString(unsigned char *characters) {
+#ifdef RDLCD_FRAMEBUFFER
     while (*characters != '\0')
     {
         RDLCDCharacter(*(characters++));
     }
+#else
+    uint8_t glyph[RDLCD_CHAR_W];
+
+    // One burst for the whole string
+    RDLCDBegin(RDLCD_D);
+    while (*characters != '\0')
+    {
+        RDLCDGlyph(glyph, *(characters++));
+        RDSPIWriteBuffer(glyph, RDLCD_CHAR_W);
+    }
+    RDSPIEndTransaction();
+#endif // RDLCD_FRAMEBUFFER
 }
 
 /**
@@ -259,11 +613,19 @@ void RDLCDString(unsigned char *characters) {
  *     The y-coordinate of the desired cursor position.
  */
 void RDLCDPosition(unsigned char x, unsigned char y) {
+#ifdef RDLCD_FRAMEBUFFER
+    if((x < RDLCD_W) & (y < RDLCD_BANKS))
+    {
+        lcdX = x;
+        lcdBank = y;
+    }
+#else
     if((x < RDLCD_W) & (y < (RDLCD_ROW_H)))
     {
         RDLCDWrite(LCD_SET_X | x, RDLCD_C);
         RDLCDWrite(LCD_SET_Y | y, RDLCD_C);
     }
+#endif // RDLCD_FRAMEBUFFER
 }
 
 #endif // RDLCD_H_
@@ -0,0 +1,496 @@
+/*
+ * libRobotDev
+ * RDLCDGraphics.h
+ * Purpose: Pixels, lines, rectangles and bitmaps on the LCD framebuffer
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: UNTESTED
+ */
+
+/*
+ * USAGE
+ *
+ *      #include "RDLCDGraphics.h"  // Turns on RDLCD_FRAMEBUFFER
+ *
+ *      RDLCDInit();
+ *      RDLCDRect(0, 0, RDLCD_W, RDLCD_H, RDLCD_PIXEL_SET);
+ *      RDLCDLine(2, 40, 81, 10, RDLCD_PIXEL_SET);
+ *      RDLCDBitmap(60, 3, icon, 16, 11, RDLCD_PIXEL_XOR);
+ *      RDLCDFlush();
+ *
+ * Everything draws into the RDLCD framebuffer and marks the columns it
+ * changes, so only those are sent by the next RDLCDFlush (or
+ * RDLCDFlushAsync). Coordinates are signed and anything outside the screen
+ * is clipped, so shapes may hang off its edges.
+ *
+ * Each shape is drawn in one of three modes: RDLCD_PIXEL_SET turns its
+ * pixels on, RDLCD_PIXEL_CLEAR turns them off and RDLCD_PIXEL_XOR inverts
+ * them, which draws a cursor or marker that a second identical call erases.
+ *
+ * Bitmaps use the display's own layout: rows of 8 pixels, each row w bytes
+ * long with one byte per column and the top pixel in the LSB, the same as
+ * RDASCIIFont. They may be drawn at any y; each byte is shifted across the
+ * two banks it lands in.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef RDLCD_FRAMEBUFFER
+#define RDLCD_FRAMEBUFFER
+#endif // RDLCD_FRAMEBUFFER
+#include "RDLCD.h"
+
+#ifndef RDLCDGRAPHICS_H_
+/**
+ * Robot Development LCD Graphics Header.
+ */
+#define RDLCDGRAPHICS_H_
+
+/**
+ * Drawing mode: turn pixels off.
+ */
+#define RDLCD_PIXEL_CLEAR   0
+
+/**
+ * Drawing mode: turn pixels on.
+ */
+#define RDLCD_PIXEL_SET     1
+
+/**
+ * Drawing mode: invert pixels.
+ */
+#define RDLCD_PIXEL_XOR     2
+
+/**
+ * Applies a mask to one column of one bank of the framebuffer, clipping it
+ * to the screen.
+ *
+ * @param x
+ *     The column.
+ *
+ * @param bank
+ *     The bank.
+ *
+ * @param mask
+ *     The pixels to draw, LSB at the top of the bank.
+ *
+ * @param mode
+ *     RDLCD_PIXEL_SET, RDLCD_PIXEL_CLEAR or RDLCD_PIXEL_XOR.
+ */
+static void RDLCDColumn(int16_t x, int16_t bank, uint8_t mask, uint8_t mode) {
+    uint8_t *cell;
+    uint8_t old;
+    uint8_t updated;
+
+    if ((uint16_t) x >= RDLCD_W || (uint16_t) bank >= RDLCD_BANKS || !mask) {
+        return;
+    }
+    cell = &lcdFrame[bank][x];
+    old = *cell;
+    if (mode == RDLCD_PIXEL_SET) {
+        updated = old | mask;
+    } else if (mode == RDLCD_PIXEL_CLEAR) {
+        updated = old & ~mask;
+    } else {
+        updated = old ^ mask;
+    }
+    if (updated != old) {
+        *cell = updated;
+        RDLCDMarkDirty(bank, x, x);
+    }
+}
+
+/**
+ * Draws a pixel.
+ *
+ * @param x
+ *     The x-coordinate.
+ *
+ * @param y
+ *     The y-coordinate.
+ *
+ * @param mode
+ *     RDLCD_PIXEL_SET, RDLCD_PIXEL_CLEAR or RDLCD_PIXEL_XOR.
+ */
+void RDLCDPixel(int16_t x, int16_t y, uint8_t mode) {
+    if (y < 0) {
+        return;
+    }
+    RDLCDColumn(x, y >> 3, 1 << (y & 7), mode);
+}
+
+/**
+ * Reads a pixel.
+ *
+ * @param x
+ *     The x-coordinate.
+ *
+ * @param y
+ *     The y-coordinate.
+ *
+ * @return
+ *     1 if the pixel is on, 0 if it is off or off the screen.
+ */
+uint8_t RDLCDGetPixel(int16_t x, int16_t y) {
+    if ((uint16_t) x >= RDLCD_W || (uint16_t) y >= RDLCD_H) {
+        return 0;
+    }
+    return (lcdFrame[y >> 3][x] >> (y & 7)) & 1;
+}
+
+/**
+ * Draws a horizontal line.
+ *
+ * @param x0
+ *     The x-coordinate of one end.
+ *
+ * @param x1
+ *     The x-coordinate of the other end.
+ *
+ * @param y
+ *     The y-coordinate.
+ *
+ * @param mode
+ *     RDLCD_PIXEL_SET, RDLCD_PIXEL_CLEAR or RDLCD_PIXEL_XOR.
+ */
+void RDLCDHLine(int16_t x0, int16_t x1, int16_t y, uint8_t mode) {
+    uint8_t mask;
+    int16_t bank;
+
+    if ((uint16_t) y >= RDLCD_H) {
+        return;
+    }
+    if (x0 > x1) {
+        int16_t swap = x0;
+        x0 = x1;
+        x1 = swap;
+    }
+    if (x0 < 0) {
+        x0 = 0;
+    }
+    if (x1 >= RDLCD_W) {
+        x1 = RDLCD_W - 1;
+    }
+    bank = y >> 3;
+    mask = 1 << (y & 7);
+    for (; x0 <= x1; x0++) {
+        RDLCDColumn(x0, bank, mask, mode);
+    }
+}
+
+/**
+ * Draws a vertical line, a whole bank at a time.
+ *
+ * @param x
+ *     The x-coordinate.
+ *
+ * @param y0
+ *     The y-coordinate of one end.
+ *
+ * @param y1
+ *     The y-coordinate of the other end.
+ *
+ * @param mode
+ *     RDLCD_PIXEL_SET, RDLCD_PIXEL_CLEAR or RDLCD_PIXEL_XOR.
+ */
+void RDLCDVLine(int16_t x, int16_t y0, int16_t y1, uint8_t mode) {
+    int16_t bank;
+    int16_t last;
+
+    if ((uint16_t) x >= RDLCD_W) {
+        return;
+    }
+    if (y0 > y1) {
+        int16_t swap = y0;
+        y0 = y1;
+        y1 = swap;
+    }
+    if (y0 < 0) {
+        y0 = 0;
+    }
+    if (y1 >= RDLCD_H) {
+        y1 = RDLCD_H - 1;
+    }
+    if (y0 > y1) {
+        return;
+    }
+    last = y1 >> 3;
+    for (bank = y0 >> 3; bank <= last; bank++) {
+        uint8_t mask = 0xFF;
+
+        if (bank == y0 >> 3) {
+            mask &= 0xFF << (y0 & 7);
+        }
+        if (bank == last) {
+            mask &= 0xFF >> (7 - (y1 & 7));
+        }
+        RDLCDColumn(x, bank, mask, mode);
+    }
+}
+
+/**
+ * Draws a line between two points (Bresenham's algorithm). Every pixel is
+ * drawn once, so lines drawn with RDLCD_PIXEL_XOR erase cleanly. The line is
+ * clipped to the screen before it is stepped through, so endpoints far off
+ * the screen cost nothing and cannot overflow the error term; the pixels
+ * drawn are the same as for the unclipped line.
+ *
+ * @param x0
+ *     The x-coordinate of the start.
+ *
+ * @param y0
+ *     The y-coordinate of the start.
+ *
+ * @param x1
+ *     The x-coordinate of the end.
+ *
+ * @param y1
+ *     The y-coordinate of the end.
+ *
+ * @param mode
+ *     RDLCD_PIXEL_SET, RDLCD_PIXEL_CLEAR or RDLCD_PIXEL_XOR.
+ */
+void RDLCDLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t mode) {
+    int32_t dx = (int32_t) x1 - x0;
+    int32_t dy = (int32_t) y1 - y0;
+    uint8_t steep = labs(dy) > labs(dx);
+
+    if (y0 == y1) {
+        RDLCDHLine(x0, x1, y0, mode);
+        return;
+    }
+    if (x0 == x1) {
+        RDLCDVLine(x0, y0, y1, mode);
+        return;
+    }
+
+    /*
+     * Step i (0 - steps) is one pixel along the major axis, and moves
+     * q(i) = floor((2 * rise * i + steps) / (2 * steps)) pixels along the
+     * minor one. Both are monotonic, so the steps on the screen are one run,
+     * first to last, found from the screen's edges on each axis.
+     */
+    int32_t major0 = steep ? y0 : x0;
+    int32_t minor0 = steep ? x0 : y0;
+    int32_t majorSize = steep ? RDLCD_H : RDLCD_W;
+    int32_t minorSize = steep ? RDLCD_W : RDLCD_H;
+    int8_t majorStep = (steep ? dy : dx) < 0 ? -1 : 1;
+    int8_t minorStep = (steep ? dx : dy) < 0 ? -1 : 1;
+    uint16_t steps = labs(steep ? dy : dx);
+    uint16_t rise = labs(steep ? dx : dy);
+    int32_t first = 0;
+    int32_t last = steps;
+    int32_t qLo;
+    int32_t qHi;
+
+    // Steps on the screen along the major axis
+    if (majorStep > 0) {
+        first = -major0 > first ? -major0 : first;
+        last = majorSize - 1 - major0 < last ? majorSize - 1 - major0 : last;
+    } else {
+        first = major0 - (majorSize - 1) > first ?
+                major0 - (majorSize - 1) : first;
+        last = major0 < last ? major0 : last;
+    }
+
+    // Minor offsets on the screen, then the steps that reach them
+    if (minorStep > 0) {
+        qLo = -minor0;
+        qHi = minorSize - 1 - minor0;
+    } else {
+        qLo = minor0 - (minorSize - 1);
+        qHi = minor0;
+    }
+    if (qLo > (int32_t) rise || qHi < 0) {
+        return;
+    }
+    if (qLo > 0) {
+        // Smallest i with rise * i >= qLo * steps - steps / 2
+        uint32_t i = ((uint32_t) qLo * steps - steps / 2 + rise - 1) / rise;
+
+        first = (int32_t) i > first ? (int32_t) i : first;
+    }
+    if (qHi < (int32_t) rise) {
+        // Largest i with rise * i <= qHi * steps + (steps - 1) / 2
+        uint32_t i = ((uint32_t) qHi * steps + (steps - 1) / 2) / rise;
+
+        last = (int32_t) i < last ? (int32_t) i : last;
+    }
+    if (first > last) {
+        return;
+    }
+
+    // Error term at the first step: 2 * rise * i + steps - 2 * steps * q
+    uint32_t along = (uint32_t) rise * first;
+    uint32_t q = along / steps;
+    uint32_t err = 2 * (along % steps) + steps;
+
+    if (err >= 2UL * steps) {
+        err -= 2UL * steps;
+        q++;
+    }
+
+    int16_t major = major0 + majorStep * first;
+    int16_t minor = minor0 + minorStep * (int32_t) q;
+
+    for (;;) {
+        if (steep) {
+            RDLCDPixel(minor, major, mode);
+        } else {
+            RDLCDPixel(major, minor, mode);
+        }
+        if (first++ == last) {
+            break;
+        }
+        major += majorStep;
+        err += 2UL * rise;
+        if (err >= 2UL * steps) {
+            err -= 2UL * steps;
+            minor += minorStep;
+        }
+    }
+}
+
+/**
+ * Draws the outline of a rectangle.
+ *
+ * @param x
+ *     The x-coordinate of the top-left corner.
+ *
+ * @param y
+ *     The y-coordinate of the top-left corner.
+ *
+ * @param w
+ *     The width.
+ *
+ * @param h
+ *     The height.
+ *
+ * @param mode
+ *     RDLCD_PIXEL_SET, RDLCD_PIXEL_CLEAR or RDLCD_PIXEL_XOR.
+ */
+void RDLCDRect(int16_t x, int16_t y, uint8_t w, uint8_t h, uint8_t mode) {
+    if (w == 0 || h == 0) {
+        return;
+    }
+    RDLCDHLine(x, x + w - 1, y, mode);
+    if (h > 1) {
+        RDLCDHLine(x, x + w - 1, y + h - 1, mode);
+    }
+    // The sides stop short of the corners so XOR leaves them set
+    if (h > 2) {
+        RDLCDVLine(x, y + 1, y + h - 2, mode);
+        if (w > 1) {
+            RDLCDVLine(x + w - 1, y + 1, y + h - 2, mode);
+        }
+    }
+}
+
+/**
+ * Draws a filled rectangle, a whole bank of each column at a time.
+ *
+ * @param x
+ *     The x-coordinate of the top-left corner.
+ *
+ * @param y
+ *     The y-coordinate of the top-left corner.
+ *
+ * @param w
+ *     The width.
+ *
+ * @param h
+ *     The height.
+ *
+ * @param mode
+ *     RDLCD_PIXEL_SET, RDLCD_PIXEL_CLEAR or RDLCD_PIXEL_XOR.
+ */
+void RDLCDFillRect(int16_t x, int16_t y, uint8_t w, uint8_t h, uint8_t mode) {
+    int16_t x1 = x + w - 1;
+    int16_t y1 = y + h - 1;
+    int16_t bank;
+    int16_t last;
+
+    if (w == 0 || h == 0) {
+        return;
+    }
+    if (x < 0) {
+        x = 0;
+    }
+    if (x1 >= RDLCD_W) {
+        x1 = RDLCD_W - 1;
+    }
+    if (y < 0) {
+        y = 0;
+    }
+    if (y1 >= RDLCD_H) {
+        y1 = RDLCD_H - 1;
+    }
+    if (x > x1 || y > y1) {
+        return;
+    }
+    last = y1 >> 3;
+    for (bank = y >> 3; bank <= last; bank++) {
+        uint8_t mask = 0xFF;
+
+        if (bank == y >> 3) {
+            mask &= 0xFF << (y & 7);
+        }
+        if (bank == last) {
+            mask &= 0xFF >> (7 - (y1 & 7));
+        }
+        for (int16_t column = x; column <= x1; column++) {
+            RDLCDColumn(column, bank, mask, mode);
+        }
+    }
+}
+
+/**
+ * Draws the set pixels of a 1-bpp bitmap at any position; its clear pixels
+ * are left alone.
+ *
+ * @param x
+ *     The x-coordinate of the top-left corner.
+ *
+ * @param y
+ *     The y-coordinate of the top-left corner.
+ *
+ * @param bitmap
+ *     The bitmap, (h + 7) / 8 rows of w bytes (see USAGE).
+ *
+ * @param w
+ *     The width.
+ *
+ * @param h
+ *     The height.
+ *
+ * @param mode
+ *     RDLCD_PIXEL_SET, RDLCD_PIXEL_CLEAR or RDLCD_PIXEL_XOR.
+ */
+void RDLCDBitmap(int16_t x, int16_t y, const uint8_t *bitmap, uint8_t w,
+                 uint8_t h, uint8_t mode) {
+    uint8_t rows = (h + 7) / 8;
+    // Floor of y / 8 and y % 8, negative y included
+    uint8_t shift = y & 7;
+    int16_t bank = (y - shift) / 8;
+
+    for (uint8_t row = 0; row < rows; row++, bank++) {
+        // Bits past h in the last row are not part of the bitmap
+        uint8_t valid = 0xFF;
+
+        if (row == rows - 1 && (h & 7)) {
+            valid = (1 << (h & 7)) - 1;
+        }
+
+        for (uint8_t column = 0; column < w; column++) {
+            uint8_t bits = *bitmap++ & valid;
+
+            RDLCDColumn(x + column, bank, bits << shift, mode);
+            if (shift) {
+                RDLCDColumn(x + column, bank + 1, bits >> (8 - shift), mode);
+            }
+        }
+    }
+}
+
+#endif // RDLCDGRAPHICS_H_
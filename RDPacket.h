@@ -0,0 +1,349 @@
+/*
+ * libRobotDev
+ * RDPacket.h
+ * Purpose: Binary packet framing over UART (COBS + CRC16)
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: UNTESTED
+ */
+
+/*
+ * USAGE
+ *
+ * Every packet is the payload followed by its CRC-16/CCITT-FALSE (high byte
+ * first), COBS encoded so that it contains no 0x00 bytes, and terminated by
+ * a single 0x00. A receiver can therefore always find the start of the next
+ * packet, and the payload costs at most one extra byte per 254.
+ *
+ * SENDING
+ *
+ *      RDPacketBegin();
+ *      RDPacketPut(id);
+ *      RDPacketWrite(samples, sizeof(samples));
+ *      RDPacketEnd();
+ *
+ *      // Or in one go
+ *      RDPacketSend(buffer, length);
+ *
+ * Bytes are encoded into the UART output buffer as they are produced, so no
+ * staging buffer is needed. RDBluetooth uses the same UART, so this also
+ * frames data sent over Bluetooth.
+ *
+ * RECEIVING
+ *
+ *      uint8_t buffer[32];
+ *      RDPacketDecoder decoder;
+ *      RDPacketDecoderInit(&decoder, buffer, sizeof(buffer));
+ *
+ *      if (RDPacketReceive(&decoder) == RDPACKET_OK) {
+ *          // decoder.length bytes of payload are in buffer
+ *      }
+ */
+
+#include <stdint.h>
+
+#include "RDCRC.h"
+#include "RDUART.h"
+
+#ifndef RDPACKET_H_
+/**
+ * Robot Development Packet Header.
+ */
+#define RDPACKET_H_
+
+/**
+ * Packet delimiter.
+ */
+#define RDPACKET_DELIMITER 0x00
+
+/**
+ * Largest payload RDPacketPut accepts. The bytes after the last zero are
+ * held back in the output buffer until their COBS code byte is known, so the
+ * whole encoded packet has to fit in it.
+ */
+#ifndef RDPACKET_MAX_PAYLOAD
+#define RDPACKET_MAX_PAYLOAD (OUTPUT_BUFFER_SIZE - 4)
+#endif // RDPACKET_MAX_PAYLOAD
+
+#if RDPACKET_MAX_PAYLOAD > OUTPUT_BUFFER_SIZE - 4
+#error "RDPACKET_MAX_PAYLOAD must be at most OUTPUT_BUFFER_SIZE - 4"
+#endif
+
+/**
+ * Decoder result: no complete packet yet.
+ */
+#define RDPACKET_NONE   0
+
+/**
+ * Decoder result: a packet with a valid CRC has been received.
+ */
+#define RDPACKET_OK     1
+
+/**
+ * Decoder result: a packet was dropped (bad CRC, bad encoding or too long).
+ */
+#define RDPACKET_ERROR  2
+
+/**
+ * Encoder state for the packet being sent.
+ */
+typedef struct {
+    RDUARTWriter writer;
+    uint8_t codeIndex;          // Output buffer slot of the open code byte
+    uint8_t code;               // Open code byte value (run length + 1)
+    uint8_t length;             // Payload bytes so far
+    uint16_t crc;
+} RDPacketEncoder;
+
+/**
+ * Decoder state, see RDPacketDecoderInit.
+ */
+typedef struct {
+    uint8_t *buffer;
+    uint8_t size;
+    uint8_t length;             // Payload length of the last packet received
+    uint8_t index;              // Bytes decoded into buffer so far
+    uint8_t remaining;          // Bytes left in the current COBS block
+    uint8_t code;               // Code byte of the current COBS block
+    uint8_t dropping;           // 1 while skipping to the next delimiter
+    uint16_t crc;
+    uint16_t errors;            // Packets dropped since initialisation
+} RDPacketDecoder;
+
+/**
+ * The packet being sent.
+ */
+static RDPacketEncoder packetEncoder;
+
+/**
+ * Adds one byte to the COBS encoding of the packet being sent.
+ *
+ * @param byte
+ *     The byte to encode.
+ */
+static void RDPacketEncode(uint8_t byte) {
+    if (byte != 0) {
+        RDUARTWriterPut(&packetEncoder.writer, byte);
+        packetEncoder.code++;
+    }
+    // A zero, or a full block of 254 non-zero bytes, closes the open block
+    if (byte == 0 || packetEncoder.code == 0xFF) {
+        RDUARTWriterPatch(&packetEncoder.writer, packetEncoder.codeIndex,
+                          packetEncoder.code);
+        packetEncoder.codeIndex = RDUARTWriterReserve(&packetEncoder.writer);
+        packetEncoder.code = 1;
+    }
+}
+
+/**
+ * Starts a packet. Nothing else may be sent over the UART until RDPacketEnd.
+ */
+void RDPacketBegin(void) {
+    RDUARTWriterBegin(&packetEncoder.writer);
+    packetEncoder.codeIndex = RDUARTWriterReserve(&packetEncoder.writer);
+    packetEncoder.code = 1;
+    packetEncoder.length = 0;
+    packetEncoder.crc = RDCRC16_INIT;
+}
+
+/**
+ * Adds one byte of payload to the packet.
+ *
+ * @param byte
+ *     The byte to add.
+ *
+ * @return
+ *     1 if the byte was added,
+ *     0 if the packet already holds RDPACKET_MAX_PAYLOAD bytes.
+ */
+uint8_t RDPacketPut(uint8_t byte) {
+    if (packetEncoder.length >= RDPACKET_MAX_PAYLOAD) {
+        return 0;
+    }
+    packetEncoder.length++;
+    packetEncoder.crc = RDCRC16Update(packetEncoder.crc, byte);
+    RDPacketEncode(byte);
+    return 1;
+}
+
+/**
+ * Adds a buffer of payload to the packet.
+ *
+ * @param data
+ *     Pointer to buffer.
+ *
+ * @param length
+ *     The length of the buffer.
+ *
+ * @return
+ *     Number of bytes added.
+ */
+uint8_t RDPacketWrite(const void *data, uint8_t length) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    uint8_t i;
+
+    for (i = 0; i < length; i++) {
+        if (!RDPacketPut(bytes[i])) {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * Appends the CRC, closes the packet and hands it to the UART.
+ *
+ * @return
+ *     Number of bytes queued for the whole packet, including framing.
+ */
+uint16_t RDPacketEnd(void) {
+    uint16_t crc = packetEncoder.crc;
+
+    RDPacketEncode(crc >> 8);
+    RDPacketEncode(crc & 0xFF);
+    RDUARTWriterPatch(&packetEncoder.writer, packetEncoder.codeIndex,
+                      packetEncoder.code);
+    RDUARTWriterPut(&packetEncoder.writer, RDPACKET_DELIMITER);
+    return RDUARTWriterEnd(&packetEncoder.writer);
+}
+
+/**
+ * Sends a buffer as one packet.
+ *
+ * @param data
+ *     Pointer to buffer.
+ *
+ * @param length
+ *     The length of the buffer, at most RDPACKET_MAX_PAYLOAD.
+ *
+ * @return
+ *     Number of bytes queued, including framing,
+ *     0 if the buffer is too long.
+ */
+uint16_t RDPacketSend(const void *data, uint8_t length) {
+    if (length > RDPACKET_MAX_PAYLOAD) {
+        return 0;
+    }
+    RDPacketBegin();
+    RDPacketWrite(data, length);
+    return RDPacketEnd();
+}
+
+/**
+ * Initialises a decoder.
+ *
+ * @param decoder
+ *     The decoder to initialise.
+ *
+ * @param buffer
+ *     Where decoded payloads are stored. Needs room for the payload and the
+ *     2 CRC bytes.
+ *
+ * @param size
+ *     The size of buffer.
+ */
+void RDPacketDecoderInit(RDPacketDecoder *decoder, uint8_t *buffer,
+                         uint8_t size) {
+    decoder->buffer = buffer;
+    decoder->size = size;
+    decoder->length = 0;
+    decoder->index = 0;
+    decoder->remaining = 0;
+    decoder->code = 0xFF;
+    decoder->dropping = 0;
+    decoder->crc = RDCRC16_INIT;
+    decoder->errors = 0;
+}
+
+/**
+ * Stores one decoded byte.
+ *
+ * @param decoder
+ *     The decoder.
+ *
+ * @param byte
+ *     The decoded byte.
+ */
+static void RDPacketDecodeStore(RDPacketDecoder *decoder, uint8_t byte) {
+    if (decoder->index >= decoder->size) {
+        decoder->dropping = 1;
+        return;
+    }
+    decoder->buffer[decoder->index++] = byte;
+    decoder->crc = RDCRC16Update(decoder->crc, byte);
+}
+
+/**
+ * Feeds one received byte to a decoder.
+ *
+ * @param decoder
+ *     The decoder.
+ *
+ * @param byte
+ *     The received byte.
+ *
+ * @return
+ *     RDPACKET_OK when byte completes a valid packet; its payload is in the
+ *     decoder's buffer and its length in decoder->length,
+ *     RDPACKET_ERROR when byte completes a packet that had to be dropped,
+ *     RDPACKET_NONE otherwise.
+ */
+uint8_t RDPacketDecode(RDPacketDecoder *decoder, uint8_t byte) {
+    uint8_t result = RDPACKET_NONE;
+
+    if (byte == RDPACKET_DELIMITER) {
+        // The CRC of payload + CRC is 0 when nothing was corrupted
+        if (decoder->dropping || decoder->remaining != 0 ||
+                decoder->index < 2 || decoder->crc != 0) {
+            // Back-to-back delimiters are just idle line, not errors
+            if (decoder->index != 0 || decoder->dropping ||
+                    decoder->remaining != 0) {
+                decoder->errors++;
+                result = RDPACKET_ERROR;
+            }
+        } else {
+            decoder->length = decoder->index - 2;
+            result = RDPACKET_OK;
+        }
+        decoder->index = 0;
+        decoder->remaining = 0;
+        decoder->code = 0xFF;
+        decoder->dropping = 0;
+        decoder->crc = RDCRC16_INIT;
+    } else if (decoder->dropping) {
+        // Skip to the next delimiter
+    } else if (decoder->remaining == 0) {
+        // New block; every block but the first and those after a full block
+        // of 254 starts with the zero that ended the previous one
+        if (decoder->code != 0xFF) {
+            RDPacketDecodeStore(decoder, 0);
+        }
+        decoder->code = byte;
+        decoder->remaining = byte - 1;
+    } else {
+        RDPacketDecodeStore(decoder, byte);
+        decoder->remaining--;
+    }
+    return result;
+}
+
+/**
+ * Feeds bytes waiting in the UART input buffer to a decoder, stopping as
+ * soon as a packet completes. Never waits for more bytes to arrive.
+ *
+ * @param decoder
+ *     The decoder.
+ *
+ * @return
+ *     See RDPacketDecode; RDPACKET_NONE once the input buffer is empty.
+ */
+uint8_t RDPacketReceive(RDPacketDecoder *decoder) {
+    uint8_t result = RDPACKET_NONE;
+
+    while (result == RDPACKET_NONE && RDUARTAvailable()) {
+        result = RDPacketDecode(decoder, RDUARTGetChar());
+    }
+    return result;
+}
+
+#endif // RDPACKET_H_
@@ -20,6 +20,60 @@
  *      #define SPI_MASTER 0  // Required
  *      #include "RDSPI.h"
  *
+ * TRANSACTIONS (MASTER MODE)
+ *
+ *      RDSPIBeginTransaction(5, 0, 0, &PORTC, PC0);
+ *      RDSPITransfer(command);
+ *      RDSPITransferBuffer(payload, NULL, sizeof(payload));
+ *      RDSPIEndTransaction();
+ *
+ * Chip select stays low from RDSPIBeginTransaction to RDSPIEndTransaction,
+ * and the clock and mode are only written to SPCR/SPSR when they differ
+ * from what is already there, so each byte costs only its shift time.
+ *
+ *      #define RDSPI_ASYNC   // Before including RDSPI.h
+ *
+ *      RDSPIBeginTransaction(...);
+ *      RDSPITransferAsync(frame, NULL, sizeof(frame), NULL);
+ *      // ... do other work ...
+ *      RDSPIEndTransaction();  // Waits for the transfer to finish
+ *
+ * With RDSPI_ASYNC, SPI_STC_vect streams the buffer one byte per interrupt
+ * and RDSPIBusy reports when it is done. An optional callback runs in the
+ * interrupt once the last byte is in, and may start the next transfer.
+ * RDSPITransferAsync only sets SPIE and never touches the global interrupt
+ * flag, so the application must enable interrupts (sei()) itself.
+ * RDSPIBeginTransaction, RDSPIBeginDevice and RDSPIRWByte wait for the bus,
+ * so another device can be used while a transfer (or a chain of them) runs
+ * in the background; it gets the bus once the transfer is done.
+ *
+ * DEVICES
+ *
+ *      static const RDSPIDevice flash =
+ *          RDSPI_DEVICE(PORTB, PB4, 0, 0, 8000000UL);
+ *
+ *      RDSPIBeginDevice(&flash);
+ *      RDSPITransferBuffer(command, NULL, 4);
+ *      RDSPIEndTransaction();
+ *
+ * A device descriptor holds a chip select, mode, bit order and the fastest
+ * clock the device allows. RDSPI_DEVICE picks the fastest SPR/SPI2X setting
+ * not above that clock from F_CPU at compile time, so devices sharing the
+ * bus each run at their own top speed, and SPCR/SPSR are only rewritten when
+ * the bus switches to a device with different settings.
+ *
+ * SLAVE BUFFERS
+ *
+ *      RDSPISlaveQueue(reply, sizeof(reply));
+ *      while (RDSPISlaveAvailable()) {
+ *          command = RDSPISlaveGetByte();
+ *      }
+ *
+ * In slave mode SPI_STC_vect stores every byte received in a ring buffer of
+ * RDSPI_SLAVE_RX_SIZE bytes and loads the next queued byte (or
+ * RDSPI_SLAVE_IDLE when none is queued) into SPDR for the master's next
+ * byte. Bytes dropped on a full receive buffer and idle bytes sent are
+ * counted in RDSPISlaveStats.
  */
 
 #ifndef RDSPI_H_
@@ -29,16 +83,88 @@
  */
 #define RDSPI_H_
 
+/**
+ * CPU Frequency, needed by RDSPI_DEVICE and RDSPIDeviceHz.
+ */
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
 #include <avr/io.h>
 
+#include "RDPinDefs.h"
+
+#ifndef SPI_MASTER
+
+/**
+ * Setting for whether the mode will be master (1) or slave (0).
+ */
+#define SPI_MASTER    1
+
+#endif // SPI_MASTER
+
 #if SPI_MASTER == 0
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
 /**
  * Stores the current byte received over SPI.
  */
 volatile uint8_t RDSPI_RxData;
 
+/**
+ * Slave ring buffer sizes. Must be powers of two, at most 256.
+ */
+#ifndef RDSPI_SLAVE_RX_SIZE
+#define RDSPI_SLAVE_RX_SIZE 32
+#endif // RDSPI_SLAVE_RX_SIZE
+
+#ifndef RDSPI_SLAVE_TX_SIZE
+#define RDSPI_SLAVE_TX_SIZE 32
+#endif // RDSPI_SLAVE_TX_SIZE
+
+#if (RDSPI_SLAVE_RX_SIZE & (RDSPI_SLAVE_RX_SIZE - 1)) != 0 || \
+    RDSPI_SLAVE_RX_SIZE > 256
+#error "RDSPI_SLAVE_RX_SIZE must be a power of two, at most 256"
+#endif
+
+#if (RDSPI_SLAVE_TX_SIZE & (RDSPI_SLAVE_TX_SIZE - 1)) != 0 || \
+    RDSPI_SLAVE_TX_SIZE > 256
+#error "RDSPI_SLAVE_TX_SIZE must be a power of two, at most 256"
+#endif
+
+#define RDSPI_SLAVE_RX_MASK (RDSPI_SLAVE_RX_SIZE - 1)
+#define RDSPI_SLAVE_TX_MASK (RDSPI_SLAVE_TX_SIZE - 1)
+
+/**
+ * Byte sent to the master when nothing is queued.
+ */
+#ifndef RDSPI_SLAVE_IDLE
+#define RDSPI_SLAVE_IDLE 0x00
+#endif // RDSPI_SLAVE_IDLE
+
+/**
+ * Slave statistics.
+ */
+typedef struct {
+    uint32_t rxBytes;           // Bytes received, including dropped ones
+    uint16_t rxOverruns;        // Bytes dropped on a full receive buffer
+    uint16_t txUnderruns;       // RDSPI_SLAVE_IDLE bytes sent for lack of data
+} RDSPISlaveStats;
+
+/**
+ * Slave ring buffers; head is the last byte written, tail the last byte
+ * read, as for the UART buffers.
+ */
+static volatile uint8_t spiSlaveRxData[RDSPI_SLAVE_RX_SIZE];
+static volatile uint8_t spiSlaveTxData[RDSPI_SLAVE_TX_SIZE];
+static volatile uint8_t spiSlaveRxHead = 0;
+static volatile uint8_t spiSlaveRxTail = 0;
+static volatile uint8_t spiSlaveTxHead = 0;
+static volatile uint8_t spiSlaveTxTail = 0;
+
+static volatile RDSPISlaveStats spiSlaveStats;
+
 #endif // SPI_MASTER
 
 /**
@@ -46,12 +172,65 @@ volatile uint8_t RDSPI_RxData;
  */
 #define SPIPORT      DDRB
 
-#ifndef SPI_MASTER
+#if SPI_MASTER == 1
 
 /**
- * Setting for whether the mode will be master (1) or slave (0).
+ * SPCR and SPSR values last written, so repeated settings can be skipped.
  */
-#define SPI_MASTER    1
+static uint8_t spiSPCR = 0;
+static uint8_t spiSPSR = 0;
+
+/*
+ * Clock setting (see RDSPISetClock) of the fastest SCK not above hz:
+ * F_CPU / 2, 4, 8, 16, 32, 64 or 128.
+ */
+#define RDSPI_FRQ(hz) \
+    ((F_CPU) / 2 <= (hz) ? 4 : \
+     (F_CPU) / 4 <= (hz) ? 0 : \
+     (F_CPU) / 8 <= (hz) ? 5 : \
+     (F_CPU) / 16 <= (hz) ? 1 : \
+     (F_CPU) / 32 <= (hz) ? 6 : \
+     (F_CPU) / 64 <= (hz) ? 2 : 3)
+
+/*
+ * SPCR and SPSR for a master talking to a device; see RDSPIInit for mode
+ * and endian.
+ */
+#define RDSPI_SPCR(mode, endian, hz) \
+    ((1 << SPE) | (1 << MSTR) | (((endian) & 1) << DORD) | \
+     (((mode) & 3) << CPHA) | (RDSPI_FRQ(hz) & 3))
+#define RDSPI_SPSR(hz)  ((RDSPI_FRQ(hz) >> 2) & 1)
+
+/**
+ * SPI device descriptor, see RDSPI_DEVICE.
+ */
+typedef struct {
+    volatile uint8_t *csPort;
+    uint8_t csPin;
+    uint8_t spcr;
+    uint8_t spsr;
+} RDSPIDevice;
+
+/**
+ * Initialiser for an RDSPIDevice.
+ *
+ * @param port
+ *     The port that the chip select pin is on, e.g. PORTC.
+ *
+ * @param pin
+ *     The chip select pin.
+ *
+ * @param mode
+ *     Clock polarity and phase, see RDSPIInit.
+ *
+ * @param endian
+ *     Bit order, see RDSPIInit.
+ *
+ * @param maxHz
+ *     Fastest clock the device allows.
+ */
+#define RDSPI_DEVICE(port, pin, mode, endian, maxHz) \
+    {&(port), (pin), RDSPI_SPCR((mode), (endian), (maxHz)), RDSPI_SPSR(maxHz)}
 
 #endif // SPI_MASTER
 
@@ -82,7 +261,14 @@ void RDSPIInit(uint8_t endian, uint8_t mode) {
     
     SPCR |= (1 << SPE);
     
+#if SPI_MASTER == 1
+    spiSPCR = SPCR;
+    spiSPSR = SPSR & (1 << SPI2X);
+#endif // SPI_MASTER
+
 #if SPI_MASTER == 0
+    // First byte out, before the queue has anything in it
+    SPDR = RDSPI_SLAVE_IDLE;
     SPCR |= (1 << SPE) | (1 << SPIE);
     sei();
 #endif // SPI_MASTER
@@ -90,6 +276,52 @@ void RDSPIInit(uint8_t endian, uint8_t mode) {
 
 #if SPI_MASTER == 1
 
+#ifdef RDSPI_ASYNC
+#include <avr/interrupt.h>
+
+/**
+ * State of the transfer being streamed by SPI_STC_vect.
+ */
+static const uint8_t *spiTx;
+static uint8_t *spiRx;
+static uint16_t spiLength;
+static uint16_t spiIndex;
+static void (*spiCallback)(void);
+static volatile uint8_t spiBusy = 0;
+#endif // RDSPI_ASYNC
+
+/**
+ * Chip select held by the current transaction.
+ */
+static volatile uint8_t *spiCSPort = 0;
+static uint8_t spiCSPin = 0;
+
+/**
+ * Writes SPCR and SPSR, unless they already hold these values.
+ */
+static inline void RDSPIApply(uint8_t spcr, uint8_t spsr) {
+    if (spcr != spiSPCR) {
+        SPCR = spcr;
+        spiSPCR = spcr;
+    }
+    if (spsr != spiSPSR) {
+        SPSR = spsr;
+        spiSPSR = spsr;
+    }
+}
+
+/**
+ * Waits until no asynchronous transfer is using the bus. A chain of
+ * transfers started from each other's callbacks, such as a background LCD
+ * flush, counts as busy from its first byte to its last, so nothing else
+ * can select a device or touch SPCR in between.
+ */
+static inline void RDSPIWaitIdle(void) {
+#ifdef RDSPI_ASYNC
+    while (spiBusy);
+#endif // RDSPI_ASYNC
+}
+
 /**
  * Sets the SPI Clock's frequency.
  * 
@@ -102,15 +334,14 @@ void RDSPIInit(uint8_t endian, uint8_t mode) {
  *     4: (F_CPU / 2),
  *     5: (F_CPU / 8),
  *     6: (F_CPU / 32),
- *     7: (F_CPU / 64).
+ *     7: (F_CPU / 64, same as 2).
  */
 static inline void RDSPISetClock(uint8_t frq) {
-    SPCR = (SPCR & ~(3 << SPR0)) | (3 & frq);
-    SPSR = (SPSR & ~(1 << SPI2X)) | (frq >> 2);
+    RDSPIApply((spiSPCR & ~(3 << SPR0)) | (3 & frq), (frq >> 2) & 1);
 }
 
 /**
- * Reads and writes using SPI.
+ * Reads and writes using SPI, once any asynchronous transfer has finished.
  * 
  * @param byte
  *     The byte to transmit.
@@ -124,7 +355,7 @@ static inline void RDSPISetClock(uint8_t frq) {
  *     4: (F_CPU / 2),
  *     5: (F_CPU / 8),
  *     6: (F_CPU / 32),
- *     7: (F_CPU / 64).
+ *     7: (F_CPU / 64, same as 2).
  * 
  * @param port
  *     The port that the chip select pin is on.
@@ -137,6 +368,8 @@ static inline void RDSPISetClock(uint8_t frq) {
  */
 uint8_t RDSPIRWByte(uint8_t byte, uint8_t frq, volatile uint8_t *port,
                     uint8_t chipSelectPin) {
+    RDSPIWaitIdle();
+
     // Disable SPI
     //SPCR &= ~(1 << SPE);
     
@@ -160,27 +393,363 @@ uint8_t RDSPIRWByte(uint8_t byte, uint8_t frq, volatile uint8_t *port,
     return SPDR;
 }
 
+/**
+ * Starts a transaction: waits for any asynchronous transfer to finish,
+ * applies the clock, mode and bit order, and pulls chip select low until
+ * RDSPIEndTransaction.
+ *
+ * @param frq
+ *     Clock frequency, see RDSPISetClock.
+ *
+ * @param mode
+ *     Clock polarity and phase, see RDSPIInit.
+ *
+ * @param endian
+ *     Bit order, see RDSPIInit.
+ *
+ * @param port
+ *     The port that the chip select pin is on.
+ *
+ * @param chipSelectPin
+ *     The chip select pin.
+ */
+void RDSPIBeginTransaction(uint8_t frq, uint8_t mode, uint8_t endian,
+                           volatile uint8_t *port, uint8_t chipSelectPin) {
+    RDSPIWaitIdle();
+    RDSPIApply((1 << SPE) | (1 << MSTR) | ((endian & 1) << DORD) |
+               ((mode & 3) << CPHA) | (frq & 3),
+               (frq >> 2) & 1);
+
+    spiCSPort = port;
+    spiCSPin = chipSelectPin;
+    *port &= ~(1 << chipSelectPin);
+}
+
+/**
+ * Starts a transaction with a device: waits for any asynchronous transfer to
+ * finish, switches the bus to its settings if they differ from the current
+ * ones, and pulls its chip select low until RDSPIEndTransaction.
+ *
+ * @param device
+ *     The device.
+ */
+void RDSPIBeginDevice(const RDSPIDevice *device) {
+    RDSPIWaitIdle();
+    RDSPIApply(device->spcr, device->spsr);
+
+    spiCSPort = device->csPort;
+    spiCSPin = device->csPin;
+    *spiCSPort &= ~(1 << spiCSPin);
+}
+
+/**
+ * Gets the clock a device runs at.
+ *
+ * @param device
+ *     The device.
+ *
+ * @return
+ *     SCK frequency in Hz.
+ */
+uint32_t RDSPIDeviceHz(const RDSPIDevice *device) {
+    static const uint8_t shift[4] = {2, 4, 6, 7};
+
+    return (F_CPU) >> (shift[device->spcr & 3] - (device->spsr & 1));
+}
+
+/**
+ * Reads and writes one byte within a transaction.
+ *
+ * @param byte
+ *     The byte to transmit.
+ *
+ * @return
+ *     The byte shifted in from the slave.
+ */
+static inline uint8_t RDSPITransfer(uint8_t byte) {
+    SPDR = byte;
+    while(!(SPSR & (1<<SPIF)));
+    return SPDR;
+}
+
+/**
+ * Reads and writes a buffer within a transaction (full-duplex).
+ *
+ * @param tx
+ *     Bytes to transmit, or NULL to transmit 0xFF.
+ *
+ * @param rx
+ *     Where to store the bytes shifted in, or NULL to discard them. May be
+ *     the same buffer as tx.
+ *
+ * @param length
+ *     Number of bytes.
+ */
+void RDSPITransferBuffer(const uint8_t *tx, uint8_t *rx, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+        uint8_t in = RDSPITransfer(tx ? tx[i] : 0xFF);
+        if (rx) {
+            rx[i] = in;
+        }
+    }
+}
+
+/**
+ * Writes a buffer within a transaction, discarding the bytes shifted in.
+ * Each byte is fetched while the previous one shifts out and loaded into
+ * SPDR as soon as SPIF is set, so the bus is only idle for the few cycles
+ * between the two.
+ *
+ * @param tx
+ *     Bytes to transmit.
+ *
+ * @param length
+ *     Number of bytes.
+ */
+void RDSPIWriteBuffer(const uint8_t *tx, uint16_t length) {
+    if (length == 0) {
+        return;
+    }
+    SPDR = *tx++;
+    while (--length) {
+        uint8_t next = *tx++;
+        while(!(SPSR & (1<<SPIF)));
+        SPDR = next;
+    }
+    while(!(SPSR & (1<<SPIF)));
+    (void) SPDR;
+}
+
+/**
+ * Writes the same byte a number of times within a transaction, see
+ * RDSPIWriteBuffer.
+ *
+ * @param byte
+ *     The byte to transmit.
+ *
+ * @param count
+ *     Number of times to transmit it.
+ */
+void RDSPIWriteRepeat(uint8_t byte, uint16_t count) {
+    while (count--) {
+        SPDR = byte;
+        while(!(SPSR & (1<<SPIF)));
+    }
+    (void) SPDR;
+}
+
+#ifdef RDSPI_ASYNC
+
+/**
+ * Checks whether an asynchronous transfer is still running.
+ *
+ * @return
+ *     1 if busy, 0 if done.
+ */
+uint8_t RDSPIBusy(void) {
+    return spiBusy;
+}
+
+/**
+ * Starts reading and writing a buffer within a transaction, returning at
+ * once. SPI_STC_vect moves one byte per interrupt; the buffers must stay
+ * valid until RDSPIBusy returns 0.
+ * Only SPIE is set here: interrupts must already be enabled, or be enabled
+ * by the caller, for the transfer to progress. This also makes it safe to
+ * call from the callback of the previous transfer, inside SPI_STC_vect.
+ *
+ * @param tx
+ *     Bytes to transmit, or NULL to transmit 0xFF.
+ *
+ * @param rx
+ *     Where to store the bytes shifted in, or NULL to discard them.
+ *
+ * @param length
+ *     Number of bytes.
+ *
+ * @param callback
+ *     Called from SPI_STC_vect when the transfer is done, or NULL.
+ */
+void RDSPITransferAsync(const uint8_t *tx, uint8_t *rx, uint16_t length,
+                        void (*callback)(void)) {
+    while (spiBusy);
+    if (length == 0) {
+        if (callback) {
+            callback();
+        }
+        return;
+    }
+
+    spiTx = tx;
+    spiRx = rx;
+    spiLength = length;
+    spiIndex = 0;
+    spiCallback = callback;
+    spiBusy = 1;
+
+    // Load the first byte before enabling the interrupt that takes it
+    SPDR = tx ? tx[0] : 0xFF;
+    spiSPCR |= (1 << SPIE);
+    SPCR = spiSPCR;
+}
+
+/**
+ * Stores the byte just shifted in and sends the next one, or finishes the
+ * transfer and runs its callback.
+ */
+ISR(SPI_STC_vect) {
+    uint8_t in = SPDR;
+
+    if (spiRx) {
+        spiRx[spiIndex] = in;
+    }
+    if (++spiIndex < spiLength) {
+        SPDR = spiTx ? spiTx[spiIndex] : 0xFF;
+    } else {
+        spiSPCR &= ~(1 << SPIE);
+        SPCR = spiSPCR;
+        spiBusy = 0;
+        if (spiCallback) {
+            spiCallback();
+        }
+    }
+}
+
+#endif // RDSPI_ASYNC
+
+/**
+ * Ends a transaction, waiting for any asynchronous transfer to finish, and
+ * releases chip select.
+ */
+void RDSPIEndTransaction(void) {
+    RDSPIWaitIdle();
+    if (spiCSPort) {
+        *spiCSPort |= (1 << spiCSPin);
+        spiCSPort = 0;
+    }
+}
+
 #else
 
 /**
- * Transmits a byte from the slave using SPI.
+ * Queues a byte for the slave to send, waiting for room if the transmit
+ * buffer is full. It goes out as the master clocks the following bytes.
  * 
  * @param byte
  *     The byte to transmit.
  */
 void RDSPISlaveTxByte(uint8_t byte) {
-    while(!(SPSR & (1<<SPIF)));
-    SPDR = byte;
+    uint8_t head = (spiSlaveTxHead + 1) & RDSPI_SLAVE_TX_MASK;
+
+    while (head == spiSlaveTxTail);
+    spiSlaveTxData[head] = byte;
+    spiSlaveTxHead = head;
+}
+
+/**
+ * Queues as much of a buffer as fits in the transmit buffer. Never waits.
+ *
+ * @param buffer
+ *     Bytes to transmit.
+ *
+ * @param length
+ *     Number of bytes.
+ *
+ * @return
+ *     Number of bytes queued.
+ */
+uint16_t RDSPISlaveQueue(const uint8_t *buffer, uint16_t length) {
+    uint8_t head = spiSlaveTxHead;
+    uint16_t i;
+
+    for (i = 0; i < length; i++) {
+        uint8_t next = (head + 1) & RDSPI_SLAVE_TX_MASK;
+        if (next == spiSlaveTxTail) {
+            break;
+        }
+        spiSlaveTxData[next] = buffer[i];
+        head = next;
+    }
+    spiSlaveTxHead = head;
+    return i;
+}
+
+/**
+ * Gets the number of received bytes waiting to be read.
+ *
+ * @return
+ *     Number of bytes.
+ */
+uint8_t RDSPISlaveAvailable(void) {
+    return (spiSlaveRxHead - spiSlaveRxTail) & RDSPI_SLAVE_RX_MASK;
+}
+
+/**
+ * Reads the oldest received byte, waiting for one if there is none.
+ *
+ * @return
+ *     The byte.
+ */
+uint8_t RDSPISlaveGetByte(void) {
+    uint8_t tail = (spiSlaveRxTail + 1) & RDSPI_SLAVE_RX_MASK;
+
+    while (spiSlaveRxHead == spiSlaveRxTail);
+    uint8_t byte = spiSlaveRxData[tail];
+    spiSlaveRxTail = tail;
+    return byte;
+}
+
+/**
+ * Gets a snapshot of the slave statistics.
+ *
+ * @param stats
+ *     Where to copy the statistics.
+ */
+void RDSPISlaveGetStats(RDSPISlaveStats *stats) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *stats = *(RDSPISlaveStats *) &spiSlaveStats;
+    }
+}
+
+/**
+ * Resets all slave statistics to zero.
+ */
+void RDSPISlaveClearStats(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        spiSlaveStats.rxBytes = 0;
+        spiSlaveStats.rxOverruns = 0;
+        spiSlaveStats.txUnderruns = 0;
+    }
 }
 
 /**
  * Whenever a Serial Transfer Complete interrupt flag is triggered, this
- * Interrupt Service Routine will store the data received, in RDSPI_RxData.
- * Then it will reset SPDR to 0.
+ * Interrupt Service Routine stores the byte received in the receive buffer
+ * (and RDSPI_RxData), then loads the next queued byte into SPDR.
  */
 ISR(SPI_STC_vect) {
-    RDSPI_RxData = SPDR;
-    SPDR = 0;
+    uint8_t byte = SPDR;
+
+    // Load the reply first, the master may clock the next byte at once
+    if (spiSlaveTxHead != spiSlaveTxTail) {
+        uint8_t tail = (spiSlaveTxTail + 1) & RDSPI_SLAVE_TX_MASK;
+        SPDR = spiSlaveTxData[tail];
+        spiSlaveTxTail = tail;
+    } else {
+        SPDR = RDSPI_SLAVE_IDLE;
+        spiSlaveStats.txUnderruns++;
+    }
+
+    RDSPI_RxData = byte;
+    spiSlaveStats.rxBytes++;
+
+    uint8_t head = (spiSlaveRxHead + 1) & RDSPI_SLAVE_RX_MASK;
+    if (head == spiSlaveRxTail) {
+        spiSlaveStats.rxOverruns++;
+    } else {
+        spiSlaveRxData[head] = byte;
+        spiSlaveRxHead = head;
+    }
 }
 
 #endif // SPI_MASTER == 1
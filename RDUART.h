@@ -9,7 +9,12 @@
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifndef RDUART_H_
 /**
@@ -29,230 +34,254 @@
 #endif
 
 /**
- * Output Buffer Size.
+ * Output Buffer Size. May be defined before including this header; must be a
+ * power of two no larger than 256.
  */
-#define OUTPUT_BUFFER_SIZE	64
+#ifndef OUTPUT_BUFFER_SIZE
+#define OUTPUT_BUFFER_SIZE  64
+#endif // OUTPUT_BUFFER_SIZE
 
 /**
- * Input Buffer Size.
+ * Input Buffer Size. May be defined before including this header; must be a
+ * power of two no larger than 256.
  */
-#define INPUT_BUFFER_SIZE	40
+#ifndef INPUT_BUFFER_SIZE
+#define INPUT_BUFFER_SIZE   64
+#endif // INPUT_BUFFER_SIZE
 
-/* Uncomment this define if you wish to erase old data in the input buffer
- * in the event of an buffer overflow
+#if (OUTPUT_BUFFER_SIZE < 2) || (OUTPUT_BUFFER_SIZE > 256) || \
+    ((OUTPUT_BUFFER_SIZE & (OUTPUT_BUFFER_SIZE - 1)) != 0)
+#error "OUTPUT_BUFFER_SIZE must be a power of two between 2 and 256"
+#endif
+
+#if (INPUT_BUFFER_SIZE < 2) || (INPUT_BUFFER_SIZE > 256) || \
+    ((INPUT_BUFFER_SIZE & (INPUT_BUFFER_SIZE - 1)) != 0)
+#error "INPUT_BUFFER_SIZE must be a power of two between 2 and 256"
+#endif
+
+/**
+ * Output Buffer index mask. Wraps an index with a single AND.
  */
-// #define _WIPE_OLD_DATA
+#define OUTPUT_BUFFER_MASK  (OUTPUT_BUFFER_SIZE - 1)
 
 /**
- * Ring Buffer data structure.
+ * Input Buffer index mask. Wraps an index with a single AND.
  */
-typedef struct {
-    uint8_t tail;
-    uint8_t head;
-    volatile uint8_t* data;
-} ring_buffer;
+#define INPUT_BUFFER_MASK   (INPUT_BUFFER_SIZE - 1)
+
+/*
+ * Baud-rate calculation.
+ * These macros only use integer constant arithmetic, so they fold to
+ * constants when baud is a literal and may also be used in #if checks.
+ * RDUART_BAUD_UBRR(baud, div) rounds to the nearest UBRR value for the normal
+ * (div = 16) or double speed (div = 8) divisor and clamps it to 0 - 4095.
+ */
+#define RDUART_DIV_ROUND(n, d)      (((n) + (d) / 2) / (d))
+#define RDUART_BAUD_DIV(baud, div)  RDUART_DIV_ROUND((F_CPU), \
+                                                     (div) * (baud))
+#define RDUART_BAUD_UBRR(baud, div) \
+    (RDUART_BAUD_DIV((baud), (div)) > 4096 ? 4095 : \
+     RDUART_BAUD_DIV((baud), (div)) < 1 ? 0 : \
+     RDUART_BAUD_DIV((baud), (div)) - 1)
+#define RDUART_BAUD_REAL(baud, div) \
+    ((F_CPU) / ((div) * (RDUART_BAUD_UBRR((baud), (div)) + 1)))
+#define RDUART_BAUD_DIFF(baud, div) \
+    (RDUART_BAUD_REAL((baud), (div)) > (baud) ? \
+     RDUART_BAUD_REAL((baud), (div)) - (baud) : \
+     (baud) - RDUART_BAUD_REAL((baud), (div)))
 
 /**
- * Pre-allocated ring buffers.
+ * 1 if double speed mode (U2X) gives a smaller baud-rate error than normal
+ * mode for the given baud-rate, otherwise 0. Normal mode is kept on a tie
+ * because it samples each bit more times.
  */
-static volatile ring_buffer outputBuffer;
-static volatile ring_buffer inputBuffer;
-static volatile uint8_t outputData[OUTPUT_BUFFER_SIZE];
-static volatile uint8_t inputData[INPUT_BUFFER_SIZE];
+#define RDUART_USE_U2X(baud) \
+    (RDUART_BAUD_DIFF((baud), 8UL) < RDUART_BAUD_DIFF((baud), 16UL))
 
-/*****************************************************************
- * Function and Implementation *
- *****************************************************************/
+/**
+ * UBRR value for the given baud-rate, for use with RDUART_USE_U2X.
+ */
+#define RDUART_UBRR(baud) \
+    (RDUART_USE_U2X(baud) ? RDUART_BAUD_UBRR((baud), 8UL) : \
+                            RDUART_BAUD_UBRR((baud), 16UL))
 
 /**
- * Basic initialization with baudrate option.
- * 
- * @param baud
- *     baud rate for the UART in bits/s
- *
+ * Baud-rate actually produced for the requested baud-rate.
  */
-void RDUARTInit(unsigned long baud)
-{
-    // Turn off interrupts
-    cli();
-    
-	// Resets the tail and headers for both input and output buffers
-    outputBuffer.tail = outputBuffer.head  = 0;
-    inputBuffer.tail = inputBuffer.head = 0;
-    
-	// Link data containers
-	outputBuffer.data = outputData;
-	inputBuffer.data = inputData;
-	
-	// Set the baud rate for the device. 
-    UBRR1 = ((F_CPU / (4 * baud)) - 1)/2;
-    
-	// Sets the control & status register A to use double transmission speeds.
-    UCSR1A = (1 << U2X1);
-   
-    // Sets the control & status register B to enable transmitting and 
-    // receiving. Transmitting and receiving interrupts is also enabled.
-    UCSR1B = (1 << RXCIE1);
-    UCSR1B |= (1 << RXEN1) | (1 << TXEN1); 
-    
-	// Sets the control & status register C. Parity bits are disabled and only 1 stop bit used.
-    // 8 bits will be used for transferral (UCSZn1 and UCSZn0 are both set to 1)
-    UCSR1C = (3 << UCSZ10);
-   
-   // Turn on interrupts
-    sei();
-}
+#define RDUART_ACTUAL_BAUD(baud) \
+    (RDUART_USE_U2X(baud) ? RDUART_BAUD_REAL((baud), 8UL) : \
+                            RDUART_BAUD_REAL((baud), 16UL))
 
 /**
- * Put a byte in the output buffer and turn on the transmit interrupt.
+ * Error of the actual baud-rate in hundredths of a percent (signed).
+ * Anything beyond about +/-200 (2%) is likely to drop bytes.
+ */
+#define RDUART_BAUD_ERROR(baud) \
+    ((long) ((long) RDUART_ACTUAL_BAUD(baud) - (long) (baud)) * 100L / \
+     (long) ((baud) / 100UL))
+
+/* Uncomment this define if you wish to erase old data in the input buffer
+ * in the event of an buffer overflow
+ */
+// #define _WIPE_OLD_DATA
+
+/*
+ * FRAME MODE
  *
- * @param data
- *     byte of data to be transmitted via UART.
+ *      #define RDUART_FRAME_DELIMITER '\n'  // Or 0x00 for COBS frames
+ *      #include "RDUART.h"
+ *
+ *      RDUARTFrame frame;
+ *      if (RDUARTGetFrame(&frame)) {
+ *          // Parse frame.data / frame.length, then frame.wrapData /
+ *          // frame.wrapLength, straight out of the input buffer
+ *          RDUARTReleaseFrame();
+ *      }
+ *
+ * The RX ISR counts delimiters as they arrive, so completed frames can be
+ * handed out as views into the input buffer without copying. A frame must
+ * fit in INPUT_BUFFER_SIZE - 1 bytes including its delimiter.
  */
-void RDUARTSendChar(uint8_t data)
-{
-    outputBuffer.head++;
-    
-    if (outputBuffer.head >= OUTPUT_BUFFER_SIZE){
-        outputBuffer.head = 0;
-    }
-    
-    // Will wait until the buffer has space before continuing
-    while (outputBuffer.tail == outputBuffer.head) {;}
-    
-    // This should usually be here however, in the event you are sending crazy amounts of data
-    // this will break the code
-    //cli();
-    
-    outputBuffer.data[outputBuffer.head] = data;
-    UCSR1B |= (1<<UDRIE1);
-    
-    //sei();
-}
+#if defined(RDUART_FRAME_DELIMITER) && defined(_WIPE_OLD_DATA)
+#error "RDUART_FRAME_DELIMITER cannot be used together with _WIPE_OLD_DATA"
+#endif
+
+/* Uncomment this define (or define it before including this header) to keep
+ * UART statistics, see RDUARTGetStats. Costs a few cycles per byte.
+ */
+// #define RDUART_STATS
+
+/* Uncomment this define (or define it before including this header) to get
+ * RDUARTStream, an avr-libc stdio stream on the UART. Costs a FILE in SRAM
+ * for each USART.
+ */
+// #define RDUART_STDIO
+
+/*
+ * USART INSTANCES
+ *
+ * RDUART_USART selects the USART driven by the RDUART* functions and
+ * defaults to USART1. Further USARTs get their own buffers, ISRs and
+ * RDUART<n>* functions (RDUART0Init, RDUART0SendChar, ...) when enabled
+ * before including this header:
+ *
+ *      #define RDUART_USART0   // Second serial link on USART0
+ *      #define RDUART_USART2   // ATmega2560-class parts only
+ *      #include "RDUART.h"
+ *
+ * Every instance is generated from RDUARTInstance.h with its registers,
+ * vectors and buffers resolved by the preprocessor, so each one compiles to
+ * the same code as a hand-written single-USART driver. All instances share
+ * the buffer sizes and options above.
+ */
+#ifndef RDUART_USART
+#define RDUART_USART 1
+#endif // RDUART_USART
 
 /**
- * Get a character from the input buffer.
- * 
- * @return
- *     The oldest byte in the input buffer.
+ * Pastes three tokens together after expanding them.
  */
-uint8_t RDUARTGetChar(void)
-{
-    // If no characters are available the function will pause until there is
-    while (inputBuffer.head == inputBuffer.tail) {;}
-    inputBuffer.tail++;
-    if (inputBuffer.tail >= INPUT_BUFFER_SIZE) {
-        inputBuffer.tail = 0;
-    }
-    return inputBuffer.data[inputBuffer.tail];
-}
+#define RDUART_CAT(a, b, c)  RDUART_CAT_(a, b, c)
+#define RDUART_CAT_(a, b, c) a ## b ## c
 
 /**
- * Put a string into the output buffer.
- * If the buffer overflows, the function will wait for the buffer to clear
- * before continuing.
- *
- * @param data
- *     A null-terminated string to be transmitted via UART.
- *  
+ * Ring Buffer data structure.
+ * Each ring has exactly one producer and one consumer (the main program and
+ * an ISR). The producer only writes head and the consumer only writes tail,
+ * so no interrupts need to be disabled to share them. head is the index of
+ * the newest byte and tail the index of the last byte consumed; the slot at
+ * tail is never written, which keeps a full ring distinct from an empty one.
  */
-void RDUARTSendString(char *data)
-{
-    do {
-        RDUARTSendChar(*data);
-    } while(*data++ != '\0');
-}
+typedef struct {
+    volatile uint8_t tail;
+    volatile uint8_t head;
+} ring_buffer;
 
 /**
- * Send a buffer of data with a specified length.
- *
- * @param data
- *     Pointer to buffer
- * @param len
- *		The length of the buffer
+ * State of a write straight into an output buffer, see RDUARTWriterBegin.
+ * Bytes are stored after the published head and only published in batches.
  */
-void RDUARTSendBuffer(char *data, uint8_t len)
-{
-    do {
-        RDUARTSendChar(*data);
-    } while(len-- != 0);
-}
+typedef struct {
+    uint8_t head;               // Last byte written, not yet published
+    uint8_t hold;               // First byte that must not be published yet
+    uint8_t holding;            // 1 while hold is in use
+    uint16_t count;             // Bytes written so far
+} RDUARTWriter;
 
 /**
- * Checks how many data bytes are currently stored in the receive buffer.
- * 
- * @return
- *     Number of data bytes are currently stored in the receive buffer.
+ * Powers of ten used to print decimal numbers by repeated subtraction, which
+ * is much cheaper than 32-bit division on the AVR. Kept in flash, read with
+ * pgm_read_dword.
  */
-uint8_t RDUARTAvailable(void)
-{
-    if (inputBuffer.head >= inputBuffer.tail) {
-        return inputBuffer.head - inputBuffer.tail;
-    }
-    return INPUT_BUFFER_SIZE + inputBuffer.head - inputBuffer.tail;
-}
+static const uint32_t RDUARTPow10[10] PROGMEM = {
+    1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL,
+    100000000UL, 1000000000UL
+};
+
+#ifdef RDUART_FRAME_DELIMITER
 
 /**
- * This interrupt service routine will transmit all characters currently in the
- * transmit buffer.
- * Once all characters have been transmitted the interrupt will be disabled.
+ * View of one received frame inside the input buffer. A frame that wraps
+ * around the end of the buffer is split into two parts; wrapData is NULL and
+ * wrapLength is 0 when it does not. The delimiter is not included.
  */
-ISR(USART1_UDRE_vect)
-{
-    if (outputBuffer.head == outputBuffer.tail) 
-    {
-        // Disable the transmit interrupt once all transmissions have completed
-        UCSR1B &= ~(1<<UDRIE1);
-    }
-    else
-    {
-        outputBuffer.tail++;
-        if (outputBuffer.tail >= OUTPUT_BUFFER_SIZE) {
-            outputBuffer.tail = 0;
-        }
-        UDR1 = outputBuffer.data[outputBuffer.tail];
-    }
-}
+typedef struct {
+    const volatile uint8_t *data;
+    uint8_t length;
+    const volatile uint8_t *wrapData;
+    uint8_t wrapLength;
+} RDUARTFrame;
+
+#endif // RDUART_FRAME_DELIMITER
+
+#ifdef RDUART_STATS
 
 /**
- * This interrupt service routine will load every byte of data received via UART into the data buffer.
- * Once the buffer is filled data received will no longer be loaded into the buffer.
+ * UART statistics.
  */
-ISR(USART1_RX_vect)
-{
-    uint8_t i;
-    i = inputBuffer.head + 1;
-    if (i >= INPUT_BUFFER_SIZE){
-        i = 0;
-    }
-
-    #ifndef _WIPE_OLD_DATA
-
-    // Checks to make sure the buffer head hasn't wrapped around and the circular buffer.
-    // In this case, data received will be lost. 
-    if (i != inputBuffer.tail)
-    {
-        inputBuffer.data[i] = UDR1;
-        inputBuffer.head = i;
-    }
-
-    #endif
-
-    #ifdef _WIPE_OLD_DATA
-
-    // If the inputBuffer.head has wrapped around the circular buffer inputBuffer.tail will be 
-    // incremented and the oldest data will be lost
-    if (i == inputBuffer.tail)
-    {
-        if (inputBuffer.tail >= INPUT_BUFFER_SIZE){
-            inputBuffer.tail = 0;
-        }
-    }
-    inputBuffer.data[i] = UDR1;
-    inputBuffer.head = i;
-
-    #endif
-}
+typedef struct {
+    uint32_t rxBytes;           // Bytes received, including dropped ones
+    uint32_t txBytes;           // Bytes handed to the transmitter
+    uint16_t rxOverflows;       // Bytes dropped (or overwritten) on a full ring
+    uint16_t hwOverruns;        // Bytes lost in hardware (DORn)
+    uint16_t framingErrors;     // Bytes with a bad stop bit (FEn)
+    uint16_t parityErrors;      // Bytes with a bad parity bit (UPEn)
+    uint8_t rxHighWater;        // Most bytes ever waiting in the input buffer
+    uint8_t txHighWater;        // Most bytes ever waiting in the output buffer
+} RDUARTStats;
+
+#endif // RDUART_STATS
+
+/*
+ * The USART selected by RDUART_USART uses the RDUART* names.
+ */
+#define RDUART_N    RDUART_USART
+#define RDUART_NAME RDUART
+#include "RDUARTInstance.h"
+
+#if defined(RDUART_USART0) && RDUART_USART != 0
+#define RDUART_N    0
+#define RDUART_NAME RDUART0
+#include "RDUARTInstance.h"
+#endif // RDUART_USART0
+
+#if defined(RDUART_USART1) && RDUART_USART != 1
+#define RDUART_N    1
+#define RDUART_NAME RDUART1
+#include "RDUARTInstance.h"
+#endif // RDUART_USART1
+
+#if defined(RDUART_USART2) && RDUART_USART != 2
+#define RDUART_N    2
+#define RDUART_NAME RDUART2
+#include "RDUARTInstance.h"
+#endif // RDUART_USART2
+
+#if defined(RDUART_USART3) && RDUART_USART != 3
+#define RDUART_N    3
+#define RDUART_NAME RDUART3
+#include "RDUARTInstance.h"
+#endif // RDUART_USART3
 
 #endif // RDUART_H_
 
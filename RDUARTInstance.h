@@ -0,0 +1,1025 @@
+/*
+ * libRobotDev
+ * RDUARTInstance.h
+ * Purpose: UART driver for one USART, included once per instance by RDUART.h
+ * Created: October 2026
+ * Author(s): Jerrold Luck, Seamus Stephens, Thomas Tutin, Jeremy Pearson
+ * Status: UNTESTED
+ */
+
+/*
+ * This file deliberately has no include guard. RDUART.h defines RDUART_N
+ * (the USART number) and RDUART_NAME (the function name prefix) and then
+ * includes it once per USART. Everything below refers to registers, vectors,
+ * buffers and functions through the UART_* macros, which are removed again
+ * at the end of the file.
+ */
+
+#if !defined(RDUART_N) || !defined(RDUART_NAME)
+#error "RDUARTInstance.h is included by RDUART.h, include that instead"
+#endif
+
+/*******************************
+ * Per-instance name mapping *
+ *******************************/
+
+#define UART_FN(name)   RDUART_CAT(RDUART_NAME, name, )
+
+#define UART_UDR        RDUART_CAT(UDR, RDUART_N, )
+#define UART_UBRR       RDUART_CAT(UBRR, RDUART_N, )
+#define UART_UCSRA      RDUART_CAT(UCSR, RDUART_N, A)
+#define UART_UCSRB      RDUART_CAT(UCSR, RDUART_N, B)
+#define UART_UCSRC      RDUART_CAT(UCSR, RDUART_N, C)
+#define UART_U2X        RDUART_CAT(U2X, RDUART_N, )
+#define UART_FE         RDUART_CAT(FE, RDUART_N, )
+#define UART_DOR        RDUART_CAT(DOR, RDUART_N, )
+#define UART_UPE        RDUART_CAT(UPE, RDUART_N, )
+#define UART_RXCIE      RDUART_CAT(RXCIE, RDUART_N, )
+#define UART_UDRIE      RDUART_CAT(UDRIE, RDUART_N, )
+#define UART_RXEN       RDUART_CAT(RXEN, RDUART_N, )
+#define UART_TXEN       RDUART_CAT(TXEN, RDUART_N, )
+#define UART_UCSZ0      RDUART_CAT(UCSZ, RDUART_N, 0)
+
+// Single-USART parts such as the ATmega328P name their vectors without a
+// number
+#if RDUART_N == 0 && !defined(USART0_RX_vect)
+#define UART_RX_VECT    USART_RX_vect
+#define UART_UDRE_VECT  USART_UDRE_vect
+#else
+#define UART_RX_VECT    RDUART_CAT(USART, RDUART_N, _RX_vect)
+#define UART_UDRE_VECT  RDUART_CAT(USART, RDUART_N, _UDRE_vect)
+#endif
+
+#define UART_OUT        RDUART_CAT(outputBuffer, RDUART_N, )
+#define UART_IN         RDUART_CAT(inputBuffer, RDUART_N, )
+#define UART_OUT_DATA   RDUART_CAT(outputData, RDUART_N, )
+#define UART_IN_DATA    RDUART_CAT(inputData, RDUART_N, )
+#define UART_BAUD       RDUART_CAT(uartBaud, RDUART_N, )
+#define UART_STATS      RDUART_CAT(uartStats, RDUART_N, )
+#define UART_FRAMES_IN  RDUART_CAT(framesReceived, RDUART_N, )
+#define UART_FRAMES_OUT RDUART_CAT(framesReleased, RDUART_N, )
+#define UART_FRAME_END  RDUART_CAT(frameEnd, RDUART_N, )
+#define UART_FRAME_HELD RDUART_CAT(frameHeld, RDUART_N, )
+
+/*****************************************************************
+ * Defines and Global Variables *
+ *****************************************************************/
+
+/**
+ * Pre-allocated ring buffers.
+ */
+static ring_buffer UART_OUT;
+static ring_buffer UART_IN;
+static volatile uint8_t UART_OUT_DATA[OUTPUT_BUFFER_SIZE];
+static volatile uint8_t UART_IN_DATA[INPUT_BUFFER_SIZE];
+
+/**
+ * Baud-rate requested by the last call to RDUARTInit.
+ */
+static unsigned long UART_BAUD;
+
+#ifdef RDUART_FRAME_DELIMITER
+
+/**
+ * Frame counters. The RX ISR counts delimiters received, the main program
+ * counts frames released, so each counter has a single writer.
+ */
+static volatile uint8_t UART_FRAMES_IN;
+static uint8_t UART_FRAMES_OUT;
+
+/**
+ * Index of the delimiter ending the frame handed out by RDUARTGetFrame, and
+ * 1 while that frame has not been released.
+ */
+static uint8_t UART_FRAME_END;
+static uint8_t UART_FRAME_HELD;
+
+#endif // RDUART_FRAME_DELIMITER
+
+#ifdef RDUART_STATS
+
+/**
+ * Statistics updated by the ISRs and the transmit functions.
+ */
+static volatile RDUARTStats UART_STATS;
+
+#endif // RDUART_STATS
+
+/*****************************************************************
+ * Function and Implementation *
+ *****************************************************************/
+
+/**
+ * Initialization with raw baud-rate register settings. RDUARTInit is usually
+ * the better choice; it works these settings out from a baud-rate.
+ * 
+ * @param ubrr
+ *     Value for UBRRn, e.g. RDUART_UBRR(baud).
+ *
+ * @param u2x
+ *     1 to use double speed mode, e.g. RDUART_USE_U2X(baud), otherwise 0.
+ */
+void UART_FN(InitUBRR)(uint16_t ubrr, uint8_t u2x)
+{
+    // Turn off interrupts
+    cli();
+    
+	// Resets the tail and headers for both input and output buffers
+    UART_OUT.tail = UART_OUT.head  = 0;
+    UART_IN.tail = UART_IN.head = 0;
+#ifdef RDUART_FRAME_DELIMITER
+    UART_FRAMES_IN = UART_FRAMES_OUT = 0;
+#endif // RDUART_FRAME_DELIMITER
+    
+	// Set the baud rate for the device. 
+    UART_UBRR = ubrr;
+    
+    // Sets the control & status register A to use double transmission speeds
+    // if requested.
+    UART_UCSRA = (u2x ? (1 << UART_U2X) : 0);
+   
+    // Sets the control & status register B to enable transmitting and 
+    // receiving. Transmitting and receiving interrupts is also enabled.
+    UART_UCSRB = (1 << UART_RXCIE);
+    UART_UCSRB |= (1 << UART_RXEN) | (1 << UART_TXEN); 
+    
+	// Sets the control & status register C. Parity bits are disabled and only 1 stop bit used.
+    // 8 bits will be used for transferral (UCSZn1 and UCSZn0 are both set to 1)
+    UART_UCSRC = (3 << UART_UCSZ0);
+   
+   // Turn on interrupts
+    sei();
+}
+
+/**
+ * Initialization with a baud-rate only known at run time. Called by
+ * RDUARTInit so the 32-bit divisions of the calculation exist only once.
+ *
+ * @param baud
+ *     baud rate for the UART in bits/s
+ */
+void UART_FN(InitBaud)(unsigned long baud)
+{
+    UART_BAUD = baud;
+    UART_FN(InitUBRR)(RDUART_UBRR(baud), RDUART_USE_U2X(baud));
+}
+
+/**
+ * Basic initialization with baudrate option.
+ * The closest UBRRn value is chosen, and double speed mode is only used
+ * when it gets closer to the requested baud-rate. This is always inlined, so
+ * when baud is a literal the whole calculation folds to constants; any other
+ * baud-rate is passed on to RDUARTInitBaud.
+ * 
+ * @param baud
+ *     baud rate for the UART in bits/s
+ *
+ */
+static inline __attribute__((always_inline))
+void UART_FN(Init)(unsigned long baud)
+{
+    if (__builtin_constant_p(baud)) {
+        UART_BAUD = baud;
+        UART_FN(InitUBRR)(RDUART_UBRR(baud), RDUART_USE_U2X(baud));
+    } else {
+        UART_FN(InitBaud)(baud);
+    }
+}
+
+/**
+ * Gets the baud-rate the UART is actually running at.
+ *
+ * @return
+ *     Achieved baud-rate in bits/s.
+ */
+unsigned long UART_FN(GetBaud)(void)
+{
+    uint8_t div = (UART_UCSRA & (1 << UART_U2X)) ? 8 : 16;
+
+    return F_CPU / (div * (UART_UBRR + 1UL));
+}
+
+/**
+ * Gets the error between the achieved and the requested baud-rate.
+ *
+ * @return
+ *     Error in hundredths of a percent, e.g. -79 means 0.79% too slow.
+ *     0 if RDUARTInit has not been called.
+ */
+int16_t UART_FN(GetBaudError)(void)
+{
+    // No baud-rate was requested if only RDUARTInitUBRR has been called
+    if (UART_BAUD < 100) {
+        return 0;
+    }
+    return (int16_t) (((long) UART_FN(GetBaud)() - (long) UART_BAUD) * 100L /
+                      (long) (UART_BAUD / 100UL));
+}
+
+#ifdef RDUART_STATS
+
+/**
+ * Updates the output buffer high-water mark after the head has moved.
+ *
+ * @param head
+ *     The newly published output buffer head.
+ */
+static inline void UART_FN(TrackTxLevel)(uint8_t head)
+{
+    uint8_t level = (head - UART_OUT.tail) & OUTPUT_BUFFER_MASK;
+
+    if (level > UART_STATS.txHighWater) {
+        UART_STATS.txHighWater = level;
+    }
+}
+
+/**
+ * Copies the UART statistics. Interrupts are held off for the copy so the
+ * counters are consistent with each other.
+ *
+ * @param stats
+ *     Where to copy the statistics to.
+ */
+void UART_FN(GetStats)(RDUARTStats *stats)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *stats = *(RDUARTStats *) &UART_STATS;
+    }
+}
+
+/**
+ * Resets all UART statistics to zero.
+ */
+void UART_FN(ClearStats)(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memset((RDUARTStats *) &UART_STATS, 0, sizeof(UART_STATS));
+    }
+}
+
+#endif // RDUART_STATS
+
+/**
+ * Put a byte in the output buffer and turn on the transmit interrupt.
+ *
+ * @param data
+ *     byte of data to be transmitted via UART.
+ */
+void UART_FN(SendChar)(uint8_t data)
+{
+    uint8_t head = (UART_OUT.head + 1) & OUTPUT_BUFFER_MASK;
+    
+    // Will wait until the buffer has space before continuing
+    while (UART_OUT.tail == head) {;}
+    
+    // The byte is stored before the new head is published, so the ISR can
+    // never transmit a slot that has not been written yet
+    UART_OUT_DATA[head] = data;
+    UART_OUT.head = head;
+#ifdef RDUART_STATS
+    UART_FN(TrackTxLevel)(head);
+#endif // RDUART_STATS
+
+    // The ISR only ever clears UDRIEn once the buffer is empty, so losing
+    // that race here costs one spurious interrupt and nothing else
+    UART_UCSRB |= (1<<UART_UDRIE);
+}
+
+/**
+ * Get a character from the input buffer.
+ * 
+ * @return
+ *     The oldest byte in the input buffer.
+ */
+uint8_t UART_FN(GetChar)(void)
+{
+    uint8_t tail;
+    uint8_t data;
+
+    // If no characters are available the function will pause until there is
+    while (UART_IN.head == UART_IN.tail) {;}
+
+#ifdef _WIPE_OLD_DATA
+    // The RX ISR also moves the tail when it overwrites old data, so in this
+    // mode the tail update must not be interrupted
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif // _WIPE_OLD_DATA
+    {
+        // The byte is read before the slot is handed back to the ISR
+        tail = (UART_IN.tail + 1) & INPUT_BUFFER_MASK;
+        data = UART_IN_DATA[tail];
+        UART_IN.tail = tail;
+    }
+
+#ifdef RDUART_FRAME_DELIMITER
+    // Keep the frame count in step when a delimiter is read byte by byte
+    if (data == RDUART_FRAME_DELIMITER) {
+        UART_FRAMES_OUT++;
+    }
+#endif // RDUART_FRAME_DELIMITER
+
+    return data;
+}
+
+/**
+ * Copies as much of a buffer as currently fits into the output buffer and
+ * turns on the transmit interrupt once.
+ * The bytes are copied in at most two chunks: one up to the end of the output
+ * buffer and, if the free space wraps around, one from its start.
+ *
+ * @param data
+ *     Pointer to buffer
+ * @param len
+ *     The length of the buffer
+ *
+ * @return
+ *     Number of bytes accepted into the output buffer.
+ */
+static uint8_t UART_FN(Enqueue)(const uint8_t *data, uint8_t len)
+{
+    uint8_t head = UART_OUT.head;
+    uint8_t space;
+    uint8_t start;
+    uint16_t chunk;
+
+    // One slot is always left empty so a full buffer can be told apart from
+    // an empty one
+    space = (UART_OUT.tail - head - 1) & OUTPUT_BUFFER_MASK;
+    if (len > space) {
+        len = space;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    // The head points at the last byte queued, so copying starts after it
+    start = (head + 1) & OUTPUT_BUFFER_MASK;
+    chunk = OUTPUT_BUFFER_SIZE - start;
+    if (chunk > len) {
+        chunk = len;
+    }
+    memcpy((uint8_t *) &UART_OUT_DATA[start], data, chunk);
+    if (chunk < len) {
+        memcpy((uint8_t *) UART_OUT_DATA, data + chunk, len - chunk);
+    }
+
+    head = (start + len - 1) & OUTPUT_BUFFER_MASK;
+
+    // The copy must land in memory before the ISR can see the new head
+    __asm__ __volatile__ ("" ::: "memory");
+    UART_OUT.head = head;
+    UART_UCSRB |= (1 << UART_UDRIE);
+#ifdef RDUART_STATS
+    UART_FN(TrackTxLevel)(head);
+#endif // RDUART_STATS
+
+    return len;
+}
+
+/**
+ * Put as much of a buffer as currently fits into the output buffer without
+ * waiting for the buffer to clear.
+ *
+ * @param data
+ *     Pointer to buffer
+ * @param len
+ *     The length of the buffer
+ *
+ * @return
+ *     Number of bytes accepted into the output buffer. The remaining bytes,
+ *     starting at data + (return value), have not been queued.
+ */
+uint16_t UART_FN(TrySendBuffer)(const char *data, uint16_t len)
+{
+    if (len > 0xFF) {
+        len = 0xFF;
+    }
+    return UART_FN(Enqueue)((const uint8_t *) data, (uint8_t) len);
+}
+
+/**
+ * Send a buffer of data with a specified length.
+ * If the buffer overflows, the function will wait for the buffer to clear
+ * before continuing.
+ *
+ * @param data
+ *     Pointer to buffer
+ * @param len
+ *     The length of the buffer
+ *
+ * @return
+ *     Number of bytes queued, which is always len.
+ */
+uint16_t UART_FN(SendBuffer)(const char *data, uint16_t len)
+{
+    uint16_t sent = 0;
+
+    while (sent < len) {
+        sent += UART_FN(TrySendBuffer)(data + sent, len - sent);
+    }
+    return sent;
+}
+
+/**
+ * Put a string into the output buffer, including its null-terminator.
+ * If the buffer overflows, the function will wait for the buffer to clear
+ * before continuing.
+ *
+ * @param data
+ *     A null-terminated string to be transmitted via UART.
+ *
+ * @return
+ *     Number of bytes queued.
+ */
+uint16_t UART_FN(SendString)(const char *data)
+{
+    return UART_FN(SendBuffer)(data, strlen(data) + 1);
+}
+
+/**
+ * Starts writing straight into the output buffer. Bytes stored with
+ * RDUARTWriterPut are not seen by the ISR until RDUARTWriterEnd, unless the
+ * buffer fills up first, in which case everything written so far (up to any
+ * reserved byte) is published and the writer waits for space.
+ * Only one write may be in progress at a time, and nothing else may be sent
+ * on this UART until it ends.
+ *
+ * @param writer
+ *     The write to start.
+ */
+void UART_FN(WriterBegin)(RDUARTWriter *writer)
+{
+    writer->head = UART_OUT.head;
+    writer->hold = 0;
+    writer->holding = 0;
+    writer->count = 0;
+}
+
+/**
+ * Publishes the bytes that are ready to be sent and turns on the transmit
+ * interrupt.
+ *
+ * @param writer
+ *     The write in progress.
+ */
+static void UART_FN(WriterPublish)(RDUARTWriter *writer)
+{
+    uint8_t head = writer->head;
+
+    if (writer->holding) {
+        head = (writer->hold - 1) & OUTPUT_BUFFER_MASK;
+    }
+    UART_OUT.head = head;
+    UART_UCSRB |= (1 << UART_UDRIE);
+#ifdef RDUART_STATS
+    UART_FN(TrackTxLevel)(head);
+#endif // RDUART_STATS
+}
+
+/**
+ * Stores one byte straight into the output buffer.
+ *
+ * @param writer
+ *     The write in progress.
+ *
+ * @param c
+ *     The byte to store.
+ */
+void UART_FN(WriterPut)(RDUARTWriter *writer, uint8_t c)
+{
+    uint8_t next = (writer->head + 1) & OUTPUT_BUFFER_MASK;
+
+    if (next == UART_OUT.tail) {
+        UART_FN(WriterPublish)(writer);
+        while (next == UART_OUT.tail) {;}
+    }
+    UART_OUT_DATA[next] = c;
+    writer->head = next;
+    writer->count++;
+}
+
+/**
+ * Stores a placeholder byte to be filled in later with RDUARTWriterPatch.
+ * Nothing from the placeholder onwards is published until the next
+ * reservation or RDUARTWriterEnd, so the bytes after it must fit in the
+ * output buffer. Only one placeholder can be held back at a time, so any
+ * earlier one must have been patched already.
+ *
+ * @param writer
+ *     The write in progress.
+ *
+ * @return
+ *     Index of the placeholder in the output buffer.
+ */
+uint8_t UART_FN(WriterReserve)(RDUARTWriter *writer)
+{
+    UART_FN(WriterPut)(writer, 0);
+    writer->hold = writer->head;
+    writer->holding = 1;
+    return writer->head;
+}
+
+/**
+ * Fills in a placeholder stored by RDUARTWriterReserve, which allows it and
+ * the bytes after it to be published.
+ *
+ * @param writer
+ *     The write in progress.
+ *
+ * @param index
+ *     Index returned by RDUARTWriterReserve.
+ *
+ * @param c
+ *     The byte to store.
+ */
+void UART_FN(WriterPatch)(RDUARTWriter *writer, uint8_t index, uint8_t c)
+{
+    UART_OUT_DATA[index] = c;
+    if (writer->holding && index == writer->hold) {
+        writer->holding = 0;
+    }
+}
+
+/**
+ * Ends a write and publishes everything written.
+ *
+ * @param writer
+ *     The write to end.
+ *
+ * @return
+ *     Number of bytes queued by the write.
+ */
+uint16_t UART_FN(WriterEnd)(RDUARTWriter *writer)
+{
+    writer->holding = 0;
+    if (writer->count) {
+        UART_FN(WriterPublish)(writer);
+    }
+    return writer->count;
+}
+
+/**
+ * Stores a number of copies of one byte, used for padding.
+ *
+ * @param writer
+ *     The formatted write in progress.
+ *
+ * @param c
+ *     The byte to store.
+ *
+ * @param n
+ *     How many copies to store.
+ */
+static void UART_FN(WriterFill)(RDUARTWriter *writer, uint8_t c, uint8_t n)
+{
+    while (n--) {
+        UART_FN(WriterPut)(writer, c);
+    }
+}
+
+/**
+ * Formats a string into the output buffer without an intermediate buffer.
+ * Supports a subset of printf that needs no floating point:
+ *     %c, %s, %d, %i, %u, %x, %X and %%,
+ *     the flags '-' (left align) and '0' (zero padding),
+ *     a field width,
+ *     the 'l' length modifier for 32-bit arguments,
+ *     a precision on %d, %i and %u, which prints the integer as a
+ *     fixed-point number with that many decimal places, e.g. %.2d of 1234
+ *     prints "12.34" and of -5 prints "-0.05".
+ *
+ * @param format
+ *     The format string.
+ *
+ * @param args
+ *     The values to format.
+ *
+ * @return
+ *     Number of bytes queued.
+ */
+uint16_t UART_FN(VPrintf)(const char *format, va_list args)
+{
+    RDUARTWriter writer;
+
+    UART_FN(WriterBegin)(&writer);
+
+    while (*format != '\0') {
+        uint8_t left = 0;
+        uint8_t zero = 0;
+        uint8_t width = 0;
+        uint8_t precision = 0;
+        uint8_t isLong = 0;
+        uint8_t sign = 0;
+        uint8_t digits;
+        uint8_t length;
+        uint32_t value;
+        char c = *format++;
+
+        if (c != '%') {
+            UART_FN(WriterPut)(&writer, c);
+            continue;
+        }
+
+        // Flags, width, precision and length modifier
+        for (;; format++) {
+            if (*format == '-') {
+                left = 1;
+            } else if (*format == '0') {
+                zero = 1;
+            } else {
+                break;
+            }
+        }
+        while (*format >= '0' && *format <= '9') {
+            width = width * 10 + (*format++ - '0');
+        }
+        if (*format == '.') {
+            format++;
+            while (*format >= '0' && *format <= '9') {
+                precision = precision * 10 + (*format++ - '0');
+            }
+            if (precision > 9) {
+                precision = 9;
+            }
+        }
+        if (*format == 'l') {
+            isLong = 1;
+            format++;
+        }
+
+        c = *format++;
+        if (c == '\0') {
+            break;
+        } else if (c == 'c' || c == '%') {
+            if (c == 'c') {
+                c = (char) va_arg(args, int);
+            }
+            if (!left && width > 1) {
+                UART_FN(WriterFill)(&writer, ' ', width - 1);
+            }
+            UART_FN(WriterPut)(&writer, c);
+            if (left && width > 1) {
+                UART_FN(WriterFill)(&writer, ' ', width - 1);
+            }
+            continue;
+        } else if (c == 's') {
+            const char *str = va_arg(args, const char *);
+            size_t len = strlen(str);
+
+            if (!left && width > len) {
+                UART_FN(WriterFill)(&writer, ' ', width - len);
+            }
+            while (*str != '\0') {
+                UART_FN(WriterPut)(&writer, *str++);
+            }
+            if (left && width > len) {
+                UART_FN(WriterFill)(&writer, ' ', width - len);
+            }
+            continue;
+        } else if (c == 'd' || c == 'i') {
+            long n = isLong ? va_arg(args, long) : va_arg(args, int);
+
+            if (n < 0) {
+                sign = 1;
+                value = -(uint32_t) n;
+            } else {
+                value = n;
+            }
+        } else if (c == 'u' || c == 'x' || c == 'X') {
+            value = isLong ? va_arg(args, unsigned long) :
+                             va_arg(args, unsigned);
+        } else {
+            // Unknown conversion, print it as it was written
+            UART_FN(WriterPut)(&writer, '%');
+            UART_FN(WriterPut)(&writer, c);
+            continue;
+        }
+
+        // Count digits, then work out the padding from the total length
+        digits = 1;
+        if (c == 'x' || c == 'X') {
+            precision = 0;
+            while (digits < 8 && (value >> (4 * digits)) != 0) {
+                digits++;
+            }
+        } else {
+            while (digits < 10 &&
+                   value >= pgm_read_dword(&RDUARTPow10[digits])) {
+                digits++;
+            }
+            if (digits <= precision) {
+                digits = precision + 1;
+            }
+        }
+        length = digits + sign + (precision ? 1 : 0);
+
+        if (!left && !zero && width > length) {
+            UART_FN(WriterFill)(&writer, ' ', width - length);
+        }
+        if (sign) {
+            UART_FN(WriterPut)(&writer, '-');
+        }
+        if (!left && zero && width > length) {
+            UART_FN(WriterFill)(&writer, '0', width - length);
+        }
+
+        if (c == 'x' || c == 'X') {
+            const char base = (c == 'x') ? 'a' - 10 : 'A' - 10;
+
+            while (digits--) {
+                uint8_t d = (value >> (4 * digits)) & 0x0F;
+                UART_FN(WriterPut)(&writer, d + (d < 10 ? '0' : base));
+            }
+        } else {
+            while (digits--) {
+                uint32_t power = pgm_read_dword(&RDUARTPow10[digits]);
+                uint8_t d = '0';
+
+                while (value >= power) {
+                    value -= power;
+                    d++;
+                }
+                UART_FN(WriterPut)(&writer, d);
+                if (precision && digits == precision) {
+                    UART_FN(WriterPut)(&writer, '.');
+                }
+            }
+        }
+
+        if (left && width > length) {
+            UART_FN(WriterFill)(&writer, ' ', width - length);
+        }
+    }
+
+    return UART_FN(WriterEnd)(&writer);
+}
+
+/**
+ * Formats a string into the output buffer without an intermediate buffer.
+ * See RDUARTVPrintf for the supported conversions.
+ *
+ * @param format
+ *     The format string.
+ *
+ * @return
+ *     Number of bytes queued.
+ */
+uint16_t UART_FN(Printf)(const char *format, ...)
+{
+    uint16_t count;
+    va_list args;
+
+    va_start(args, format);
+    count = UART_FN(VPrintf)(format, args);
+    va_end(args);
+    return count;
+}
+
+#ifdef RDUART_STDIO
+
+/**
+ * Character output function for the UART stdio stream.
+ */
+static int UART_FN(StreamPut)(char c, FILE *stream)
+{
+    (void) stream;
+    UART_FN(SendChar)(c);
+    return 0;
+}
+
+/**
+ * Character input function for the UART stdio stream.
+ */
+static int UART_FN(StreamGet)(FILE *stream)
+{
+    (void) stream;
+    return UART_FN(GetChar)();
+}
+
+/**
+ * avr-libc stdio stream bound to this UART, with RDUART_STDIO. Characters
+ * written to it go straight into the output buffer, e.g.
+ *
+ *      stdout = stdin = &RDUARTStream;
+ *      printf("%d\n", x);
+ */
+FILE UART_FN(Stream) = FDEV_SETUP_STREAM(UART_FN(StreamPut), UART_FN(StreamGet),
+                                         _FDEV_SETUP_RW);
+
+#endif // RDUART_STDIO
+
+/**
+ * Checks how many data bytes are currently stored in the receive buffer.
+ * 
+ * @return
+ *     Number of data bytes are currently stored in the receive buffer.
+ */
+uint8_t UART_FN(Available)(void)
+{
+    return (UART_IN.head - UART_IN.tail) & INPUT_BUFFER_MASK;
+}
+
+#ifdef RDUART_FRAME_DELIMITER
+
+/**
+ * Gets the oldest complete frame in the input buffer without copying it.
+ * The frame stays valid, and keeps its space in the input buffer, until
+ * RDUARTReleaseFrame is called. Calling this again before releasing returns
+ * the same frame.
+ * If the input buffer fills up without a delimiter, its contents can never
+ * form a frame and are discarded so reception can continue.
+ *
+ * @param frame
+ *     Filled in with a view of the frame when one is available.
+ *
+ * @return
+ *     1 if a frame is available,
+ *     0 if no complete frame has been received.
+ */
+uint8_t UART_FN(GetFrame)(RDUARTFrame *frame)
+{
+    uint8_t start = (UART_IN.tail + 1) & INPUT_BUFFER_MASK;
+    uint8_t length = 0;
+    uint8_t i = start;
+
+    if (UART_FRAMES_IN == UART_FRAMES_OUT) {
+        // The full check comes first: once full, the ISR cannot store a
+        // delimiter between the two checks
+        if (UART_FN(Available)() == INPUT_BUFFER_MASK &&
+                UART_FRAMES_IN == UART_FRAMES_OUT) {
+            UART_IN.tail = UART_IN.head;
+        }
+        return 0;
+    }
+
+    // A delimiter is known to be in the buffer, so the scan always ends
+    while (UART_IN_DATA[i] != RDUART_FRAME_DELIMITER) {
+        i = (i + 1) & INPUT_BUFFER_MASK;
+        length++;
+    }
+    UART_FRAME_END = i;
+    UART_FRAME_HELD = 1;
+
+    frame->data = &UART_IN_DATA[start];
+    if (length > INPUT_BUFFER_SIZE - start) {
+        frame->length = INPUT_BUFFER_SIZE - start;
+        frame->wrapData = UART_IN_DATA;
+        frame->wrapLength = length - frame->length;
+    } else {
+        frame->length = length;
+        frame->wrapData = NULL;
+        frame->wrapLength = 0;
+    }
+    return 1;
+}
+
+/**
+ * Releases the frame returned by RDUARTGetFrame, handing its space, including
+ * the delimiter, back to the RX ISR. Does nothing when no frame is held, so
+ * unread bytes are never thrown away.
+ */
+void UART_FN(ReleaseFrame)(void)
+{
+    if (!UART_FRAME_HELD) {
+        return;
+    }
+    UART_FRAME_HELD = 0;
+    UART_IN.tail = UART_FRAME_END;
+    UART_FRAMES_OUT++;
+}
+
+#endif // RDUART_FRAME_DELIMITER
+
+/**
+ * This interrupt service routine will transmit all characters currently in the
+ * transmit buffer.
+ * Once all characters have been transmitted the interrupt will be disabled.
+ */
+ISR(UART_UDRE_VECT)
+{
+    uint8_t tail = UART_OUT.tail;
+
+    if (UART_OUT.head == tail) 
+    {
+        // Disable the transmit interrupt once all transmissions have completed
+        UART_UCSRB &= ~(1<<UART_UDRIE);
+    }
+    else
+    {
+        tail = (tail + 1) & OUTPUT_BUFFER_MASK;
+        UART_UDR = UART_OUT_DATA[tail];
+        UART_OUT.tail = tail;
+#ifdef RDUART_STATS
+        UART_STATS.txBytes++;
+#endif // RDUART_STATS
+    }
+}
+
+/**
+ * This interrupt service routine will load every byte of data received via UART into the data buffer.
+ * Once the buffer is filled data received will no longer be loaded into the buffer.
+ */
+ISR(UART_RX_VECT)
+{
+    uint8_t i;
+#ifdef RDUART_STATS
+    // The error flags describe the byte in UDRn, so they are read first
+    uint8_t status = UART_UCSRA;
+#endif // RDUART_STATS
+    // UDRn is always read, otherwise RXCn stays set and the ISR re-enters
+    // forever while the buffer is full
+    uint8_t data = UART_UDR;
+    i = (UART_IN.head + 1) & INPUT_BUFFER_MASK;
+
+#ifdef RDUART_STATS
+    UART_STATS.rxBytes++;
+    if (status & ((1 << UART_FE) | (1 << UART_DOR) | (1 << UART_UPE))) {
+        if (status & (1 << UART_FE)) {
+            UART_STATS.framingErrors++;
+        }
+        if (status & (1 << UART_DOR)) {
+            UART_STATS.hwOverruns++;
+        }
+        if (status & (1 << UART_UPE)) {
+            UART_STATS.parityErrors++;
+        }
+    }
+#endif // RDUART_STATS
+
+    #ifndef _WIPE_OLD_DATA
+
+    // Checks to make sure the buffer head hasn't wrapped around and the circular buffer.
+    // In this case, data received will be lost. 
+    if (i != UART_IN.tail)
+    {
+        UART_IN_DATA[i] = data;
+        UART_IN.head = i;
+#ifdef RDUART_FRAME_DELIMITER
+        if (data == RDUART_FRAME_DELIMITER) {
+            UART_FRAMES_IN++;
+        }
+#endif // RDUART_FRAME_DELIMITER
+    }
+#ifdef RDUART_STATS
+    else
+    {
+        UART_STATS.rxOverflows++;
+    }
+#endif // RDUART_STATS
+
+    #endif
+
+    #ifdef _WIPE_OLD_DATA
+
+    // If the head has wrapped around the circular buffer the tail will be
+    // incremented and the oldest data will be lost
+    if (i == UART_IN.tail)
+    {
+        UART_IN.tail = (i + 1) & INPUT_BUFFER_MASK;
+#ifdef RDUART_STATS
+        UART_STATS.rxOverflows++;
+#endif // RDUART_STATS
+    }
+    UART_IN_DATA[i] = data;
+    UART_IN.head = i;
+
+    #endif
+
+#ifdef RDUART_STATS
+    // A dropped byte leaves the level unchanged, so this is always safe
+    i = (UART_IN.head - UART_IN.tail) & INPUT_BUFFER_MASK;
+    if (i > UART_STATS.rxHighWater) {
+        UART_STATS.rxHighWater = i;
+    }
+#endif // RDUART_STATS
+}
+
+#undef UART_FN
+#undef UART_UDR
+#undef UART_UBRR
+#undef UART_UCSRA
+#undef UART_UCSRB
+#undef UART_UCSRC
+#undef UART_U2X
+#undef UART_FE
+#undef UART_DOR
+#undef UART_UPE
+#undef UART_RXCIE
+#undef UART_UDRIE
+#undef UART_RXEN
+#undef UART_TXEN
+#undef UART_UCSZ0
+#undef UART_RX_VECT
+#undef UART_UDRE_VECT
+#undef UART_OUT
+#undef UART_IN
+#undef UART_OUT_DATA
+#undef UART_IN_DATA
+#undef UART_BAUD
+#undef UART_STATS
+#undef UART_FRAMES_IN
+#undef UART_FRAMES_OUT
+#undef UART_FRAME_END
+#undef UART_FRAME_HELD
+#undef RDUART_N
+#undef RDUART_NAME
@@ -0,0 +1,538 @@
+/*
+ * libRobotDev
+ * File: RDLCDGraphicsBenchmark.c
+ * Purpose: Host-side check and rendering benchmark of RDLCDGraphics.h
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: TESTED
+ */
+
+/*
+ * Every primitive is drawn at random positions, on and off the screen, in
+ * all three modes, and the framebuffer is compared after each one with a
+ * one-byte-per-pixel reference drawn the obvious way. Every so often the
+ * frame is flushed, alternately with RDLCDFlush and RDLCDFlushAsync, to a
+ * model of the PCD8544 fed with the bytes shifted out over SPI (see
+ * avr/io.h), which must then match the reference too. Background flushes
+ * run SPI_STC_vect from an interval timer (see avr/interrupt.h), which also
+ * checks that interrupts stay disabled while it chains the next span. Each
+ * background flush is followed at once by a transaction with a second
+ * device on the same bus, which must wait for the flush: no byte may go out
+ * with both chip selects low or with the other device's settings. Then
+ * lines with endpoints anywhere in the int16_t range must draw the same
+ * pixels as the reference, which steps through every point of them.
+ * Finally each primitive is timed on its own.
+ */
+
+#define F_CPU 16000000UL
+#define RDLCD_ASYNC
+#include "RDLCDGraphics.h"
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+
+/**
+ * Primitives drawn and checked.
+ */
+#define CHECK_PRIMITIVES    20000
+
+/**
+ * Primitives drawn between two flushes.
+ */
+#define FLUSH_INTERVAL      50
+
+/**
+ * Primitives drawn per benchmark.
+ */
+#define BENCHMARK_PRIMITIVES 500000UL
+
+/**
+ * Reference screen, one byte per pixel.
+ */
+static uint8_t reference[RDLCD_H][RDLCD_W];
+
+/**
+ * Model of the display's RAM and address counters.
+ */
+static uint8_t display[RDLCD_BANKS][RDLCD_W];
+static uint8_t displayX;
+static uint8_t displayBank;
+static uint8_t displayExtended;
+
+/**
+ * Times SPI_STC_vect found interrupts enabled after it returned.
+ */
+static volatile uint32_t nestedInterrupts;
+
+/**
+ * Second device on the bus, with a different mode, bit order and clock.
+ */
+static const RDSPIDevice otherDevice =
+    RDSPI_DEVICE(PORTB, PB4, 3, 1, 1000000UL);
+
+/**
+ * Bytes the second device has received, and how many of them.
+ */
+static uint8_t otherLog[16];
+static uint8_t otherLogged;
+
+/**
+ * Bytes shifted out with both chip selects low, or with the wrong settings
+ * for the device selected.
+ */
+static uint32_t busErrors;
+
+/**
+ * 16x11 test bitmap in the display's layout.
+ */
+static const uint8_t icon[2 * 16] = {
+    0xFF, 0x01, 0x7D, 0x45, 0x45, 0x7D, 0x01, 0xFF,
+    0x00, 0x3C, 0x42, 0x81, 0x81, 0x42, 0x3C, 0x00,
+    0x07, 0x04, 0x05, 0x05, 0x05, 0x05, 0x04, 0x07,
+    0x00, 0x00, 0x01, 0x02, 0x02, 0x01, 0x00, 0x00
+};
+
+/**
+ * Small xorshift generator for the test's own choices.
+ */
+static uint32_t Random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/**
+ * Takes one byte shifted out over SPI, the way the PCD8544 and the second
+ * device do.
+ */
+static void BusShift(uint8_t byte)
+{
+    uint8_t lcd = !(PORTC & (1 << RDLCD_CS));
+    uint8_t other = !(PORTB & (1 << PB4));
+    uint8_t spcr = SPCR & ~(1 << SPIE);
+
+    if (lcd && other) {
+        busErrors++;
+        return;
+    }
+    if (other) {
+        if (spcr != otherDevice.spcr) {
+            busErrors++;
+        }
+        if (otherLogged < sizeof(otherLog)) {
+            otherLog[otherLogged++] = byte;
+        }
+        return;
+    }
+    if (!lcd) {
+        return;
+    }
+    if (spcr != RDLCDDevice.spcr) {
+        busErrors++;
+    }
+    if (PORTC & (1 << RDLCD_DC)) {
+        display[displayBank][displayX] = byte;
+        if (++displayX == RDLCD_W) {
+            displayX = 0;
+            if (++displayBank == RDLCD_BANKS) {
+                displayBank = 0;
+            }
+        }
+    } else if ((byte & 0xF8) == LCD_BSC_FN) {
+        displayExtended = byte & 1;
+    } else if (!displayExtended && (byte & 0x80)) {
+        displayX = byte & 0x7F;
+    } else if (!displayExtended && (byte & 0xC0) == LCD_SET_Y) {
+        displayBank = byte & 0x07;
+    }
+}
+
+/**
+ * Simulated interrupt, plays the part of the SPI hardware.
+ */
+static void Interrupt(int sig)
+{
+    (void) sig;
+    if (SPCR & (1 << SPIE)) {
+        hostSPIComplete();
+        SPI_STC_vect();
+        if (hostIrqEnabled()) {
+            nestedInterrupts++;
+            cli();
+        }
+    }
+}
+
+/**
+ * Draws a pixel on the reference screen.
+ */
+static void RefPixel(int32_t x, int32_t y, uint8_t mode)
+{
+    if (x < 0 || x >= RDLCD_W || y < 0 || y >= RDLCD_H) {
+        return;
+    }
+    if (mode == RDLCD_PIXEL_SET) {
+        reference[y][x] = 1;
+    } else if (mode == RDLCD_PIXEL_CLEAR) {
+        reference[y][x] = 0;
+    } else {
+        reference[y][x] ^= 1;
+    }
+}
+
+/**
+ * Draws a line on the reference screen, stepping along the major axis and
+ * rounding the minor one.
+ */
+static void RefLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
+                    uint8_t mode)
+{
+    int32_t dx = (int32_t) x1 - x0;
+    int32_t dy = (int32_t) y1 - y0;
+    int32_t steps = labs(dx) > labs(dy) ? labs(dx) : labs(dy);
+    int32_t i;
+
+    for (i = 0; i <= steps; i++) {
+        // Halves round away from the start, as Bresenham's error term does
+        int64_t nx = (int64_t) 2 * dx * i;
+        int64_t ny = (int64_t) 2 * dy * i;
+        int32_t x = x0;
+        int32_t y = y0;
+
+        if (steps) {
+            x += (nx + (nx < 0 ? -steps : steps)) / (2 * steps);
+            y += (ny + (ny < 0 ? -steps : steps)) / (2 * steps);
+        }
+        RefPixel(x, y, mode);
+    }
+}
+
+/**
+ * Compares the framebuffer, and optionally the display, with the reference.
+ *
+ * @return
+ *     Number of pixels that differ.
+ */
+static uint16_t Compare(uint8_t withDisplay)
+{
+    uint16_t differ = 0;
+    int16_t x;
+    int16_t y;
+
+    for (y = 0; y < RDLCD_H; y++) {
+        for (x = 0; x < RDLCD_W; x++) {
+            uint8_t expected = reference[y][x];
+
+            if (RDLCDGetPixel(x, y) != expected) {
+                differ++;
+            }
+            if (withDisplay &&
+                    ((display[y >> 3][x] >> (y & 7)) & 1) != expected) {
+                differ++;
+            }
+        }
+    }
+    return differ;
+}
+
+/**
+ * Random coordinate from a little off one edge of the screen to a little
+ * off the other.
+ */
+static int16_t RandomCoordinate(uint32_t *state, int16_t size)
+{
+    return (int16_t) (Random(state) % (size + 40)) - 20;
+}
+
+/**
+ * Draws one random primitive on both screens.
+ *
+ * @return
+ *     Name of the primitive.
+ */
+static const char *DrawRandom(uint32_t *state)
+{
+    uint32_t r = Random(state);
+    uint8_t mode = r % 3;
+    int16_t x0 = RandomCoordinate(state, RDLCD_W);
+    int16_t y0 = RandomCoordinate(state, RDLCD_H);
+    int16_t x1 = RandomCoordinate(state, RDLCD_W);
+    int16_t y1 = RandomCoordinate(state, RDLCD_H);
+    uint8_t w = 1 + (Random(state) % 40);
+    uint8_t h = 1 + (Random(state) % 30);
+    int16_t i;
+    int16_t j;
+
+    switch ((r >> 4) % 7) {
+    case 0:
+        RDLCDPixel(x0, y0, mode);
+        RefPixel(x0, y0, mode);
+        return "pixel";
+    case 1:
+        RDLCDHLine(x0, x1, y0, mode);
+        for (i = x0 < x1 ? x0 : x1; i <= (x0 < x1 ? x1 : x0); i++) {
+            RefPixel(i, y0, mode);
+        }
+        return "hline";
+    case 2:
+        RDLCDVLine(x0, y0, y1, mode);
+        for (i = y0 < y1 ? y0 : y1; i <= (y0 < y1 ? y1 : y0); i++) {
+            RefPixel(x0, i, mode);
+        }
+        return "vline";
+    case 3:
+        RDLCDLine(x0, y0, x1, y1, mode);
+        RefLine(x0, y0, x1, y1, mode);
+        return "line";
+    case 4:
+        RDLCDRect(x0, y0, w, h, mode);
+        for (i = 0; i < w; i++) {
+            for (j = 0; j < h; j++) {
+                if (i == 0 || j == 0 || i == w - 1 || j == h - 1) {
+                    RefPixel(x0 + i, y0 + j, mode);
+                }
+            }
+        }
+        return "rect";
+    case 5:
+        RDLCDFillRect(x0, y0, w, h, mode);
+        for (i = 0; i < w; i++) {
+            for (j = 0; j < h; j++) {
+                RefPixel(x0 + i, y0 + j, mode);
+            }
+        }
+        return "fillrect";
+    default:
+        RDLCDBitmap(x0, y0, icon, 16, 11, mode);
+        for (i = 0; i < 16; i++) {
+            for (j = 0; j < 11; j++) {
+                if ((icon[(j >> 3) * 16 + i] >> (j & 7)) & 1) {
+                    RefPixel(x0 + i, y0 + j, mode);
+                }
+            }
+        }
+        return "bitmap";
+    }
+}
+
+/**
+ * Draws lines with endpoints anywhere in the int16_t range, most of them
+ * crossing the screen, checking the framebuffer after each.
+ *
+ * @return
+ *     0 on success, 1 on failure.
+ */
+static int CheckFarLines(void)
+{
+    static const int16_t corners[][4] = {
+        { -32768, -32768, 32767, 32767 },
+        { 32767, -32768, -32768, 32767 },
+        { -32768, 20, 32767, 21 },
+        { 40, -32768, 41, 32767 },
+        { -32768, -32767, 32767, 32767 },
+        { 0, 0, 32767, 32766 }
+    };
+    uint32_t state = 0x2545F491UL;
+    int i;
+
+    for (i = 0; i < 2000; i++) {
+        int16_t x0;
+        int16_t y0;
+        int16_t x1;
+        int16_t y1;
+        uint8_t mode = i % 3;
+
+        if (i < (int) (sizeof(corners) / sizeof(corners[0]))) {
+            x0 = corners[i][0];
+            y0 = corners[i][1];
+            x1 = corners[i][2];
+            y1 = corners[i][3];
+        } else {
+            // Through a random point near the screen, out to far away
+            int16_t cx = RandomCoordinate(&state, RDLCD_W);
+            int16_t cy = RandomCoordinate(&state, RDLCD_H);
+            int32_t fx = (int32_t) (int16_t) Random(&state) - cx;
+            int32_t fy = (int32_t) (int16_t) Random(&state) - cy;
+            int32_t scale = 1 + Random(&state) % 4;
+
+            x0 = cx - fx / scale;
+            y0 = cy - fy / scale;
+            x1 = (int16_t) Random(&state);
+            y1 = (int16_t) Random(&state);
+        }
+        RDLCDLine(x0, y0, x1, y1, mode);
+        RefLine(x0, y0, x1, y1, mode);
+        if (Compare(0) != 0) {
+            printf("FAIL: framebuffer differs after line (%d,%d)-(%d,%d)\n",
+                   x0, y0, x1, y1);
+            return 1;
+        }
+    }
+    printf("far lines: %d lines\n", i);
+    return 0;
+}
+
+/**
+ * Draws random primitives, checking the framebuffer after each and the
+ * display after each flush.
+ *
+ * @return
+ *     0 on success, 1 on failure.
+ */
+static int Check(void)
+{
+    uint32_t state = 0x12345678UL;
+    uint32_t flushed = 0;
+    uint32_t interleaved = 0;
+    struct sigaction action;
+    struct itimerval timer = { { 0, 10 }, { 0, 10 } };
+    int i;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Interrupt;
+    sigaction(HOST_IRQ_SIGNAL, &action, NULL);
+    hostSPIShift = BusShift;
+    PORTB |= (1 << PB4);
+
+    // The display RAM starts out as noise; the first flush overwrites it
+    memset(display, 0xA5, sizeof(display));
+    RDLCDInit();
+    sei();
+    setitimer(ITIMER_REAL, &timer, NULL);
+
+    for (i = 1; i <= CHECK_PRIMITIVES; i++) {
+        const char *name = DrawRandom(&state);
+
+        if (Compare(0) != 0) {
+            printf("FAIL: framebuffer differs after %s %d\n", name, i);
+            return 1;
+        }
+        if (i % FLUSH_INTERVAL == 0) {
+            if ((i / FLUSH_INTERVAL) & 1) {
+                static const uint8_t message[4] = { 0xDE, 0xAD, 0xBE, 0xEF };
+
+                flushed += RDLCDFlushAsync();
+                interleaved += RDLCDBusy();
+
+                // Has to wait for the whole frame before it gets the bus
+                otherLogged = 0;
+                RDSPIBeginDevice(&otherDevice);
+                RDSPITransferBuffer(message, NULL, sizeof(message));
+                RDSPIEndTransaction();
+                if (RDLCDBusy() || otherLogged != sizeof(message) ||
+                        memcmp(otherLog, message, sizeof(message)) != 0) {
+                    printf("FAIL: second device transaction at %d went "
+                           "wrong\n", i);
+                    return 1;
+                }
+            } else {
+                flushed += RDLCDFlush();
+            }
+            if (Compare(1) != 0) {
+                printf("FAIL: display differs after flush at %d\n", i);
+                return 1;
+            }
+        }
+    }
+
+    timer.it_value.tv_usec = 0;
+    setitimer(ITIMER_REAL, &timer, NULL);
+    hostSPIShift = NULL;
+
+    if (busErrors != 0 || interleaved == 0) {
+        printf("FAIL: %lu bytes sent to the wrong device, %lu transactions "
+               "behind a flush\n", (unsigned long) busErrors,
+               (unsigned long) interleaved);
+        return 1;
+    }
+    if (nestedInterrupts != 0) {
+        printf("FAIL: SPI_STC_vect enabled interrupts %lu times\n",
+               (unsigned long) nestedInterrupts);
+        return 1;
+    }
+    printf("check: %d primitives, %lu bytes flushed, %lu transactions "
+           "behind a flush\n", CHECK_PRIMITIVES, (unsigned long) flushed,
+           (unsigned long) interleaved);
+    return 0;
+}
+
+/**
+ * Seconds since an arbitrary start.
+ */
+static double Now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * Times each primitive with random coordinates inside the screen, and lines
+ * through the screen with endpoints far outside it.
+ */
+static void Benchmark(void)
+{
+    static int16_t coordinates[4096];
+    const char *names[] = {
+        "pixel", "line", "farline", "rect", "fillrect", "bitmap"
+    };
+    uint32_t state = 0xCAFEF00DUL;
+    uint8_t primitive;
+    uint32_t i;
+
+    for (i = 0; i < 4096; i += 2) {
+        coordinates[i] = Random(&state) % RDLCD_W;
+        coordinates[i + 1] = Random(&state) % RDLCD_H;
+    }
+
+    for (primitive = 0; primitive < 6; primitive++) {
+        double start = Now();
+        double elapsed;
+
+        for (i = 0; i < BENCHMARK_PRIMITIVES; i++) {
+            const int16_t *c = &coordinates[(i * 4) & 4095];
+
+            switch (primitive) {
+            case 0:
+                RDLCDPixel(c[0], c[1], RDLCD_PIXEL_XOR);
+                break;
+            case 1:
+                RDLCDLine(c[0], c[1], c[2], c[3], RDLCD_PIXEL_XOR);
+                break;
+            case 2:
+                // The same line, stretched 600 times past both ends
+                RDLCDLine(c[0] - 300 * (c[2] - c[0]),
+                          c[1] - 300 * (c[3] - c[1]),
+                          c[2] + 300 * (c[2] - c[0]),
+                          c[3] + 300 * (c[3] - c[1]), RDLCD_PIXEL_XOR);
+                break;
+            case 3:
+                RDLCDRect(c[0] / 2, c[1] / 2, 24, 16, RDLCD_PIXEL_XOR);
+                break;
+            case 4:
+                RDLCDFillRect(c[0] / 2, c[1] / 2, 24, 16, RDLCD_PIXEL_XOR);
+                break;
+            default:
+                RDLCDBitmap(c[0], c[1], icon, 16, 11, RDLCD_PIXEL_XOR);
+                break;
+            }
+        }
+        elapsed = Now() - start;
+        printf("%-8s %10.0f primitives/s\n", names[primitive],
+               BENCHMARK_PRIMITIVES / elapsed);
+    }
+}
+
+int main(void)
+{
+    if (Check() || CheckFarLines()) {
+        return 1;
+    }
+    Benchmark();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,309 @@
+/*
+ * libRobotDev
+ * File: RDPacketBenchmark.c
+ * Purpose: Host-side round trip test and throughput benchmark of RDPacket.h
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: TESTED
+ */
+
+/*
+ * First, random packets are sent with RDPacketSend and RDPacketBegin / Put /
+ * Write / End while an interval timer plays the part of the USART (see
+ * avr/interrupt.h). Each interrupt moves a few bytes from the UDRE ISR onto
+ * a simulated wire and from the wire into the RX ISR, and every packet must
+ * come back intact from RDPacketReceive.
+ * Then, with the timer off, the encoder (draining the output buffer by
+ * calling the UDRE ISR directly), the decoder and RDCRC16 are timed.
+ *
+ * The Makefile also builds RDPacketBenchmark16 with 16-byte UART buffers, the
+ * smallest RDPacket.h allows, where every packet has to wrap the ring.
+ */
+
+#ifndef OUTPUT_BUFFER_SIZE
+#define OUTPUT_BUFFER_SIZE  256
+#endif // OUTPUT_BUFFER_SIZE
+#ifndef INPUT_BUFFER_SIZE
+#define INPUT_BUFFER_SIZE   256
+#endif // INPUT_BUFFER_SIZE
+#include "RDPacket.h"
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+
+/**
+ * Packets sent in the round trip test.
+ */
+#define ROUND_TRIP_PACKETS  3000
+
+/**
+ * Packets encoded and decoded in the benchmark.
+ */
+#define BENCHMARK_PACKETS   200000UL
+
+/**
+ * Bytes on the simulated wire, written by the UDRE ISR and read by the RX ISR.
+ */
+static uint8_t wire[1UL << 20];
+static volatile uint32_t wireIn;
+static volatile uint32_t wireOut;
+
+/**
+ * State of the interrupt handler's own random generator.
+ */
+static uint32_t interruptState = 0x9E3779B9UL;
+
+/**
+ * Small xorshift generator for the test's own choices.
+ */
+static uint32_t Random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/**
+ * Simulated interrupt, plays the part of the USART and the wire.
+ */
+static void Interrupt(int sig)
+{
+    uint8_t burst = 1 + (Random(&interruptState) & 7);
+    uint8_t i;
+
+    (void) sig;
+    for (i = 0; i < burst && (UCSR1B & (1 << UDRIE1)); i++) {
+        uint8_t tail = outputBuffer1.tail;
+
+        USART1_UDRE_vect();
+        if (outputBuffer1.tail != tail && wireIn < sizeof(wire)) {
+            wire[wireIn] = UDR1;
+            wireIn++;
+        }
+    }
+
+    burst = 1 + (Random(&interruptState) & 7);
+    for (i = 0; i < burst && wireOut < wireIn &&
+             ((inputBuffer1.tail - inputBuffer1.head - 1) & INPUT_BUFFER_MASK);
+             i++) {
+        UDR1 = wire[wireOut];
+        wireOut++;
+        USART1_RX_vect();
+    }
+}
+
+/**
+ * Fills a payload with a random length and random content. Some payloads are
+ * mostly zeros, some have none, so every kind of COBS block gets used.
+ *
+ * @return
+ *     Payload length.
+ */
+static uint8_t RandomPayload(uint32_t *state, uint8_t *payload)
+{
+    uint32_t r = Random(state);
+    uint8_t length = r % (RDPACKET_MAX_PAYLOAD + 1);
+    uint8_t zeros = (r >> 8) & 3;
+    uint8_t i;
+
+    // A full-size packet without zeros fills a whole 254-byte block
+    if (((r >> 10) & 15) == 0) {
+        length = RDPACKET_MAX_PAYLOAD;
+        zeros = 0;
+    }
+    for (i = 0; i < length; i++) {
+        uint8_t byte = (uint8_t) Random(state);
+
+        if (zeros == 0 && byte == 0) {
+            byte = 0x5A;
+        } else if (zeros == 3 && (byte & 1)) {
+            byte = 0;
+        }
+        payload[i] = byte;
+    }
+    return length;
+}
+
+/**
+ * Seconds since an arbitrary start.
+ */
+static double Now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * Sends random packets through the simulated UART and checks each one comes
+ * back from RDPacketReceive.
+ *
+ * @return
+ *     0 on success, 1 on failure.
+ */
+static int RoundTrip(void)
+{
+    uint8_t payload[RDPACKET_MAX_PAYLOAD];
+    uint8_t received[RDPACKET_MAX_PAYLOAD + 2];
+    uint32_t state = 0x12345678UL;
+    struct sigaction action;
+    struct itimerval timer = { { 0, 10 }, { 0, 10 } };
+    RDPacketDecoder decoder;
+    int packets;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Interrupt;
+    sigaction(HOST_IRQ_SIGNAL, &action, NULL);
+
+    RDUARTInit(1000000);
+    RDPacketDecoderInit(&decoder, received, sizeof(received));
+    setitimer(ITIMER_REAL, &timer, NULL);
+
+    for (packets = 0; packets < ROUND_TRIP_PACKETS; packets++) {
+        uint8_t length = RandomPayload(&state, payload);
+        uint8_t result;
+
+        if (packets & 1) {
+            RDPacketSend(payload, length);
+        } else {
+            uint8_t split = length / 3;
+            uint8_t i;
+
+            RDPacketBegin();
+            for (i = 0; i < split; i++) {
+                RDPacketPut(payload[i]);
+            }
+            RDPacketWrite(payload + split, length - split);
+            RDPacketEnd();
+        }
+
+        do {
+            result = RDPacketReceive(&decoder);
+        } while (result == RDPACKET_NONE);
+
+        if (result != RDPACKET_OK || decoder.length != length ||
+                memcmp(received, payload, length) != 0) {
+            timer.it_value.tv_usec = 0;
+            setitimer(ITIMER_REAL, &timer, NULL);
+            printf("FAIL: packet %d of %u bytes came back wrong\n", packets,
+                   length);
+            return 1;
+        }
+    }
+
+    timer.it_value.tv_usec = 0;
+    setitimer(ITIMER_REAL, &timer, NULL);
+    printf("round trip: %d packets, %lu bytes on the wire, %u dropped\n",
+           packets, (unsigned long) wireIn, decoder.errors);
+    return 0;
+}
+
+/**
+ * Times the encoder, the decoder and the CRC.
+ *
+ * @return
+ *     0 on success, 1 on failure.
+ */
+static int Benchmark(void)
+{
+    static uint8_t payload[RDPACKET_MAX_PAYLOAD];
+    static uint8_t data[1UL << 15];
+    uint8_t received[RDPACKET_MAX_PAYLOAD + 2];
+    uint32_t state = 0xCAFEF00DUL;
+    uint32_t payloadBytes = 0;
+    uint32_t encodedBytes = 0;
+    uint32_t decoded = 0;
+    uint32_t i;
+    uint16_t crc = 0;
+    RDPacketDecoder decoder;
+    double start;
+    double encodeTime;
+    double decodeTime;
+    double crcTime;
+
+    /*
+     * Encoder, one payload reused so the generator is not timed. With no
+     * interrupts the whole packet has to fit in the output buffer, so the
+     * longest payloads are left out.
+     */
+    for (i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t) Random(&state) & 0x3F;
+    }
+    wireIn = 0;
+    start = Now();
+    for (i = 0; i < BENCHMARK_PACKETS; i++) {
+        uint8_t length = (i * 7) % (RDPACKET_MAX_PAYLOAD - 3);
+
+        RDPacketBegin();
+        RDPacketWrite(payload, length);
+        RDPacketEnd();
+        while (UCSR1B & (1 << UDRIE1)) {
+            uint8_t tail = outputBuffer1.tail;
+
+            USART1_UDRE_vect();
+            if (i < 1024 && outputBuffer1.tail != tail) {
+                wire[wireIn++] = UDR1;
+            }
+        }
+        payloadBytes += length;
+    }
+    encodeTime = Now() - start;
+
+    // Decoder, over the first 1024 packets captured above
+    encodedBytes = wireIn;
+    RDPacketDecoderInit(&decoder, received, sizeof(received));
+    start = Now();
+    for (i = 0; i < BENCHMARK_PACKETS / 1024; i++) {
+        uint32_t j;
+
+        for (j = 0; j < encodedBytes; j++) {
+            if (RDPacketDecode(&decoder, wire[j]) == RDPACKET_OK) {
+                decoded++;
+            }
+        }
+    }
+    decodeTime = Now() - start;
+    if (decoded != (BENCHMARK_PACKETS / 1024) * 1024 || decoder.errors != 0) {
+        printf("FAIL: decoded %lu packets with %u errors\n",
+               (unsigned long) decoded, decoder.errors);
+        return 1;
+    }
+
+    // CRC
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) Random(&state);
+    }
+    start = Now();
+    for (i = 0; i < 512; i++) {
+        crc += RDCRC16(data + (i & 7), sizeof(data) - 8);
+    }
+    crcTime = Now() - start;
+
+    printf("encode: %.0f packets/s, %.1f MB/s of payload (UDRE ISR "
+           "included)\n", BENCHMARK_PACKETS / encodeTime,
+           payloadBytes / encodeTime / 1e6);
+    printf("decode: %.0f packets/s, %.1f MB/s on the wire\n",
+           decoded / decodeTime,
+           (double) encodedBytes * (BENCHMARK_PACKETS / 1024) /
+           decodeTime / 1e6);
+    printf("crc16:  %.1f MB/s (%04x)\n",
+           512.0 * (sizeof(data) - 8) / crcTime / 1e6, crc);
+    return 0;
+}
+
+int main(void)
+{
+    // Check value of CRC-16/CCITT-FALSE
+    if (RDCRC16((const uint8_t *) "123456789", 9) != 0x29B1) {
+        printf("FAIL: RDCRC16 check value\n");
+        return 1;
+    }
+    if (RoundTrip() || Benchmark()) {
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
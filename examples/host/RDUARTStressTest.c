@@ -0,0 +1,186 @@
+/*
+ * libRobotDev
+ * File: RDUARTStressTest.c
+ * Purpose: Host-side stress test of the UART rings against simulated ISRs
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: TESTED
+ */
+
+/*
+ * The main program pushes a long mix of RDUARTSendChar, RDUARTSendBuffer,
+ * RDUARTTrySendBuffer and RDUARTPrintf into a small output ring while reading
+ * a known byte sequence out of a small input ring. An interval timer
+ * interrupts it at arbitrary instructions (see avr/interrupt.h); each
+ * interrupt runs the UDRE ISR, logging the byte it transmits, and the RX ISR
+ * with the next byte of the sequence whenever the input ring has space. Every
+ * byte must come out of each ring once, in order.
+ */
+
+#define OUTPUT_BUFFER_SIZE  16
+#define INPUT_BUFFER_SIZE   16
+#define RDUART_STATS
+#include "RDUART.h"
+
+#include <stdio.h>
+#include <sys/time.h>
+
+/**
+ * Bytes to push through each direction.
+ */
+#define TX_BYTES    200000UL
+#define RX_BYTES    200000UL
+
+/**
+ * Bytes the transmitter has sent, and how many of them.
+ */
+static uint8_t txLog[TX_BYTES + 64];
+static volatile uint32_t txLogged;
+
+/**
+ * Bytes fed to the RX ISR so far.
+ */
+static volatile uint32_t rxInjected;
+
+/**
+ * Interrupts taken.
+ */
+static volatile uint32_t interrupts;
+
+/**
+ * Byte i of the received sequence.
+ */
+static uint8_t RxPattern(uint32_t i)
+{
+    return (uint8_t) ((i * 2654435761UL) >> 13);
+}
+
+/**
+ * Small xorshift generator for the test's own choices.
+ */
+static uint32_t Random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/**
+ * Simulated interrupt, plays the part of the USART hardware.
+ */
+static void Interrupt(int sig)
+{
+    (void) sig;
+    interrupts++;
+
+    // The transmitter takes a byte whenever the UDRE interrupt is enabled
+    if (UCSR1B & (1 << UDRIE1)) {
+        uint8_t tail = outputBuffer1.tail;
+
+        USART1_UDRE_vect();
+        if (outputBuffer1.tail != tail && txLogged < sizeof(txLog)) {
+            txLog[txLogged] = UDR1;
+            txLogged++;
+        }
+    }
+
+    // A byte arrives whenever there is room for it, like a sender that uses
+    // flow control
+    if (rxInjected < RX_BYTES &&
+            ((inputBuffer1.tail - inputBuffer1.head - 1) & INPUT_BUFFER_MASK)) {
+        UDR1 = RxPattern(rxInjected);
+        rxInjected++;
+        USART1_RX_vect();
+    }
+}
+
+int main(void)
+{
+    static uint8_t expected[TX_BYTES + 64];
+    uint32_t expectedLength = 0;
+    uint32_t rxReceived = 0;
+    uint32_t rxErrors = 0;
+    uint32_t state = 0x12345678UL;
+    uint32_t spins = 0;
+    struct sigaction action;
+    struct itimerval timer = { { 0, 10 }, { 0, 10 } };
+    RDUARTStats stats;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Interrupt;
+    sigaction(HOST_IRQ_SIGNAL, &action, NULL);
+
+    RDUARTInit(1000000);
+    setitimer(ITIMER_REAL, &timer, NULL);
+
+    while (expectedLength < TX_BYTES || rxReceived < RX_BYTES) {
+        if (expectedLength < TX_BYTES) {
+            uint32_t r = Random(&state);
+            uint8_t buffer[40];
+            uint16_t len = 1 + (r >> 8) % sizeof(buffer);
+            uint16_t i;
+
+            for (i = 0; i < len; i++) {
+                buffer[i] = (uint8_t) Random(&state);
+            }
+
+            switch (r & 3) {
+            case 0:
+                RDUARTSendChar(buffer[0]);
+                len = 1;
+                break;
+            case 1:
+                RDUARTSendBuffer((const char *) buffer, len);
+                break;
+            case 2:
+                len = RDUARTTrySendBuffer((const char *) buffer, len);
+                break;
+            default:
+                len = RDUARTPrintf("%lu:%5d,%x;", (unsigned long) r,
+                                   (int) (int16_t) r, (unsigned) (r >> 20));
+                snprintf((char *) buffer, sizeof(buffer), "%lu:%5d,%x;",
+                         (unsigned long) r, (int) (int16_t) r,
+                         (unsigned) (r >> 20));
+                break;
+            }
+            memcpy(&expected[expectedLength], buffer, len);
+            expectedLength += len;
+        }
+
+        while (RDUARTAvailable()) {
+            if (RDUARTGetChar() != RxPattern(rxReceived)) {
+                rxErrors++;
+            }
+            rxReceived++;
+        }
+    }
+
+    // Let the transmitter drain
+    while (txLogged < expectedLength && ++spins < 4000000000UL) { ; }
+    timer.it_value.tv_usec = 0;
+    setitimer(ITIMER_REAL, &timer, NULL);
+    RDUARTGetStats(&stats);
+
+    printf("tx: %lu of %lu bytes sent, rx: %lu bytes received, "
+           "%lu interrupts\n", (unsigned long) txLogged,
+           (unsigned long) expectedLength, (unsigned long) rxReceived,
+           (unsigned long) interrupts);
+
+    if (txLogged != expectedLength ||
+            memcmp(txLog, expected, expectedLength) != 0) {
+        printf("FAIL: transmitted bytes differ from the bytes queued\n");
+        return 1;
+    }
+    if (rxErrors != 0 || stats.rxOverflows != 0) {
+        printf("FAIL: %lu bytes received out of order, %u dropped\n",
+               (unsigned long) rxErrors, stats.rxOverflows);
+        return 1;
+    }
+    if (stats.txBytes != expectedLength || stats.rxBytes != RX_BYTES) {
+        printf("FAIL: statistics do not match the traffic\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
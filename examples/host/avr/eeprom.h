@@ -0,0 +1,27 @@
+/*
+ * libRobotDev
+ * examples/host/avr/eeprom.h
+ * Purpose: Host stand-in for <avr/eeprom.h>
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: TESTED
+ */
+
+#include <string.h>
+
+#ifndef HOST_AVR_EEPROM_H_
+/**
+ * Host AVR EEPROM stub header.
+ */
+#define HOST_AVR_EEPROM_H_
+
+/*
+ * Variables placed in EEPROM are ordinary variables, so reads and writes
+ * are plain copies.
+ */
+#define EEMEM
+
+#define eeprom_read_block(dst, src, n)      memcpy((dst), (src), (n))
+#define eeprom_update_block(src, dst, n)    memcpy((dst), (src), (n))
+
+#endif // HOST_AVR_EEPROM_H_
@@ -0,0 +1,73 @@
+/*
+ * libRobotDev
+ * examples/host/avr/interrupt.h
+ * Purpose: Host stand-in for <avr/interrupt.h>
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: TESTED
+ */
+
+#include <signal.h>
+#include <stddef.h>
+
+#ifndef HOST_AVR_INTERRUPT_H_
+/**
+ * Host AVR interrupt stub header.
+ */
+#define HOST_AVR_INTERRUPT_H_
+
+/*
+ * An interrupt is simulated by a HOST_IRQ_SIGNAL from an interval timer. The
+ * handler runs to completion between two instructions of the main program,
+ * just like an ISR on the AVR, and cli()/sei() block and unblock the signal
+ * in place of the global interrupt flag.
+ */
+#define HOST_IRQ_SIGNAL SIGALRM
+
+/**
+ * An ISR becomes a plain function that the signal handler calls.
+ */
+#define ISR(vector, ...) void vector(void)
+
+/**
+ * Blocks or unblocks the simulated interrupts.
+ *
+ * @param how
+ *     SIG_BLOCK or SIG_UNBLOCK.
+ *
+ * @return
+ *     1 if interrupts were enabled before the call, otherwise 0.
+ */
+static inline unsigned char hostIrqMask(int how)
+{
+    sigset_t set;
+    sigset_t old;
+
+    sigemptyset(&set);
+    sigaddset(&set, HOST_IRQ_SIGNAL);
+    sigprocmask(how, &set, &old);
+    return !sigismember(&old, HOST_IRQ_SIGNAL);
+}
+
+static inline void cli(void)
+{
+    hostIrqMask(SIG_BLOCK);
+}
+
+static inline void sei(void)
+{
+    hostIrqMask(SIG_UNBLOCK);
+}
+
+/**
+ * 1 if simulated interrupts are enabled, the I bit of SREG on the AVR.
+ */
+static inline unsigned char hostIrqEnabled(void)
+{
+    sigset_t old;
+
+    sigprocmask(SIG_BLOCK, NULL, &old);
+    return !sigismember(&old, HOST_IRQ_SIGNAL);
+}
+
+#endif // HOST_AVR_INTERRUPT_H_
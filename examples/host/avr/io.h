@@ -0,0 +1,142 @@
+/*
+ * libRobotDev
+ * examples/host/avr/io.h
+ * Purpose: Host stand-in for <avr/io.h>
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: TESTED
+ */
+
+#include <stdint.h>
+
+#ifndef HOST_AVR_IO_H_
+/**
+ * Host AVR register stub header.
+ */
+#define HOST_AVR_IO_H_
+
+/*
+ * Each I/O register is a plain variable. A test plays the part of the
+ * hardware by reading and writing them around calls to the ISRs. Every test
+ * program is a single translation unit, like the library itself.
+ */
+
+/*
+ * USART1
+ */
+static volatile uint8_t UDR1;
+static volatile uint16_t UBRR1;
+static volatile uint8_t UCSR1A;
+static volatile uint8_t UCSR1B;
+static volatile uint8_t UCSR1C;
+
+#define RXC1    7
+#define TXC1    6
+#define UDRE1   5
+#define FE1     4
+#define DOR1    3
+#define UPE1    2
+#define U2X1    1
+
+#define RXCIE1  7
+#define TXCIE1  6
+#define UDRIE1  5
+#define RXEN1   4
+#define TXEN1   3
+
+#define UCSZ10  1
+
+/*
+ * Ports B and C
+ */
+static volatile uint8_t DDRB;
+static volatile uint8_t PORTB;
+static volatile uint8_t PINB;
+static volatile uint8_t DDRC;
+static volatile uint8_t PORTC;
+static volatile uint8_t PINC;
+
+#define PB0     0
+#define PB1     1
+#define PB2     2
+#define PB3     3
+#define PB4     4
+#define PB5     5
+#define PB6     6
+#define PB7     7
+
+#define PC0     0
+#define PC1     1
+#define PC2     2
+#define PC3     3
+#define PC4     4
+#define PC5     5
+#define PC6     6
+#define PC7     7
+
+/*
+ * SPI
+ * A byte finishes shifting the moment it is written, so SPIF always reads as
+ * set. Code polls SPIF once after each byte it writes to SPDR, so the first
+ * SPSR access after SPDR has been touched is when a byte counts as sent: it
+ * is passed to hostSPIShift, if set. An interrupt-driven transfer has no
+ * poll, so a test calls hostSPIComplete before each call to SPI_STC_vect.
+ */
+static volatile uint8_t SPCR;
+static volatile uint8_t hostSPDR;
+static volatile uint8_t hostSPSR;
+static uint8_t hostSPDRTouched;
+static void (*hostSPIShift)(uint8_t byte);
+
+#define SPIE    7
+#define SPE     6
+#define DORD    5
+#define MSTR    4
+#define CPOL    3
+#define CPHA    2
+#define SPR1    1
+#define SPR0    0
+
+#define SPIF    7
+#define WCOL    6
+#define SPI2X   0
+
+static inline volatile uint8_t *hostSPDRAccess(void)
+{
+    hostSPDRTouched = 1;
+    return &hostSPDR;
+}
+
+static inline void hostSPIComplete(void)
+{
+    if (hostSPDRTouched) {
+        hostSPDRTouched = 0;
+        if (hostSPIShift) {
+            hostSPIShift(hostSPDR);
+        }
+    }
+}
+
+static inline volatile uint8_t *hostSPSRAccess(void)
+{
+    hostSPIComplete();
+    hostSPSR |= (1 << SPIF);
+    return &hostSPSR;
+}
+
+#define SPDR    (*hostSPDRAccess())
+#define SPSR    (*hostSPSRAccess())
+
+/*
+ * avr-libc stdio streams. The stream is left empty; the put and get functions
+ * are only referenced so they do not count as unused.
+ */
+#define _FDEV_SETUP_RW 3
+#define FDEV_SETUP_STREAM(put, get, rwflag) \
+    { 0 }; \
+    static void *const HOST_CAT(hostStream, __COUNTER__)[] \
+        __attribute__((unused)) = { (void *) (put), (void *) (get) }
+#define HOST_CAT(a, b)  HOST_CAT_(a, b)
+#define HOST_CAT_(a, b) a ## b
+
+#endif // HOST_AVR_IO_H_
@@ -0,0 +1,28 @@
+/*
+ * libRobotDev
+ * examples/host/avr/pgmspace.h
+ * Purpose: Host stand-in for <avr/pgmspace.h>
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: TESTED
+ */
+
+#include <stdint.h>
+
+#ifndef HOST_AVR_PGMSPACE_H_
+/**
+ * Host AVR program memory stub header.
+ */
+#define HOST_AVR_PGMSPACE_H_
+
+/*
+ * The host has one address space, so data placed in flash is ordinary
+ * constant data and reading it is a plain load.
+ */
+#define PROGMEM
+
+#define pgm_read_byte(address)  (*(const uint8_t *) (address))
+#define pgm_read_word(address)  (*(const uint16_t *) (address))
+#define pgm_read_dword(address) (*(const uint32_t *) (address))
+
+#endif // HOST_AVR_PGMSPACE_H_
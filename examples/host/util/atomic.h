@@ -0,0 +1,41 @@
+/*
+ * libRobotDev
+ * examples/host/util/atomic.h
+ * Purpose: Host stand-in for <util/atomic.h>
+ * Created: October 2026
+ * Author(s): Jeremy Pearson
+ * Status: TESTED
+ */
+
+#include <avr/interrupt.h>
+
+#ifndef HOST_UTIL_ATOMIC_H_
+/**
+ * Host AVR atomic block stub header.
+ */
+#define HOST_UTIL_ATOMIC_H_
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON      1
+
+/**
+ * Re-enables the simulated interrupts when an ATOMIC_BLOCK is left, if they
+ * were enabled when it was entered.
+ */
+static inline void hostAtomicExit(unsigned char *enabled)
+{
+    if (*enabled) {
+        sei();
+    }
+}
+
+/**
+ * Runs the following block with simulated interrupts held off. Leaving the
+ * block by any path restores them, as in avr-libc.
+ */
+#define ATOMIC_BLOCK(type) \
+    for (unsigned char hostIrq_ __attribute__((cleanup(hostAtomicExit))) = \
+             hostIrqMask(SIG_BLOCK) | (type), hostOnce_ = 1; \
+         hostOnce_; hostOnce_ = 0)
+
+#endif // HOST_UTIL_ATOMIC_H_